@@ -0,0 +1,188 @@
+/*
+ * Concurrent queue stress test
+ *
+ * Several producer and consumer kernel threads share a small concurrent queue,
+ * half of them using the batch operations. Every item carries its producer and
+ * a per-producer sequence number, which lets the test check that:
+ *
+ * - every item is dequeued exactly once,
+ * - each consumer sees the items of a given producer in the order they were
+ *   enqueued, as required for the queue to be a linearizable FIFO.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cqueue.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define ITEMS 200000
+#define CAPACITY 64
+#define BATCH 8
+
+/* Items are encoded as pointers, sequence numbers start at 1 so none is NULL */
+#define ITEM(producer, seq) ((void*)(((uintptr_t)(producer) << 32) | (seq)))
+#define ITEM_PRODUCER(item) ((uintptr_t)(item) >> 32)
+#define ITEM_SEQ(item) ((uintptr_t)(item) & 0xffffffff)
+
+static cqueue_t cq;
+/* number of times each item was dequeued */
+static atomic_uchar seen[PRODUCERS][ITEMS + 1];
+static atomic_int consumed;
+static atomic_int order_errors;
+
+static void *producer(void *arg)
+{
+	uintptr_t id = (uintptr_t)arg;
+	void *batch[BATCH];
+	uintptr_t seq = 1;
+
+	while (seq <= ITEMS) {
+		if (id % 2 == 0) {
+			/* single item */
+			if (cqueue_try_enqueue(cq, ITEM(id, seq)) == 0)
+				seq++;
+			else
+				sched_yield();
+			continue;
+		}
+
+		/* batch of consecutive items, part of it may be enqueued */
+		int n = 0;
+		while (n < BATCH && seq + n <= ITEMS) {
+			batch[n] = ITEM(id, seq + n);
+			n++;
+		}
+		n = cqueue_try_enqueue_batch(cq, batch, n);
+		if (n == 0)
+			sched_yield();
+		seq += n;
+	}
+
+	return NULL;
+}
+
+static void check_item(void *item, uintptr_t last[PRODUCERS])
+{
+	uintptr_t p = ITEM_PRODUCER(item);
+	uintptr_t seq = ITEM_SEQ(item);
+
+	if (seq <= last[p])
+		atomic_fetch_add(&order_errors, 1);
+	last[p] = seq;
+	atomic_fetch_add(&seen[p][seq], 1);
+	atomic_fetch_add(&consumed, 1);
+}
+
+static void *consumer(void *arg)
+{
+	uintptr_t id = (uintptr_t)arg;
+	uintptr_t last[PRODUCERS] = {0};
+	void *batch[BATCH];
+	void *item;
+
+	while (atomic_load(&consumed) < PRODUCERS * ITEMS) {
+		if (id % 2 == 0) {
+			if (cqueue_try_dequeue(cq, &item) == 0)
+				check_item(item, last);
+			else
+				sched_yield();
+			continue;
+		}
+
+		int n = cqueue_try_dequeue_batch(cq, batch, BATCH);
+		if (n == 0)
+			sched_yield();
+		for (int i = 0; i < n; i++)
+			check_item(batch[i], last);
+	}
+
+	return NULL;
+}
+
+/*
+ * Failed operations yield the CPU, so that the test also makes progress on a
+ * single CPU where spinning would burn whole time slices.
+ */
+
+/* Single thread behaviour at the bounds */
+void test_bounds(void)
+{
+	int data[CAPACITY + 1], *ptr;
+	void *batch[3] = {&data[0], &data[1], &data[2]};
+	int i, ok = 1;
+
+	fprintf(stderr, "*** TEST bounds ***\n");
+
+	cq = cqueue_create(CAPACITY - 1);
+	for (i = 0; i < CAPACITY; i++)
+		ok = ok && cqueue_try_enqueue(cq, &data[i]) == 0;
+	TEST_ASSERT(ok);
+	TEST_ASSERT(cqueue_try_enqueue(cq, &data[CAPACITY]) == -1);
+	TEST_ASSERT(cqueue_length(cq) == CAPACITY);
+	TEST_ASSERT(cqueue_destroy(cq) == -1);
+	for (i = 0; i < CAPACITY; i++) {
+		cqueue_try_dequeue(cq, (void**)&ptr);
+		ok = ok && ptr == &data[i];
+	}
+	TEST_ASSERT(ok);
+	TEST_ASSERT(cqueue_try_dequeue(cq, (void**)&ptr) == -1);
+	TEST_ASSERT(cqueue_try_enqueue_batch(cq, batch, 3) == 3);
+	TEST_ASSERT(cqueue_try_dequeue_batch(cq, batch, 2) == 2);
+	TEST_ASSERT(batch[0] == &data[0] && batch[1] == &data[1]);
+	TEST_ASSERT(cqueue_try_dequeue_batch(cq, batch, 2) == 1);
+	TEST_ASSERT(batch[0] == &data[2]);
+	TEST_ASSERT(cqueue_destroy(cq) == 0);
+}
+
+/* Producers and consumers racing on a small queue */
+void test_stress(void)
+{
+	pthread_t producers[PRODUCERS], consumers[CONSUMERS];
+	uintptr_t i;
+	int p, seq, ok = 1;
+
+	fprintf(stderr, "*** TEST stress ***\n");
+
+	cq = cqueue_create(CAPACITY);
+	for (i = 0; i < CONSUMERS; i++)
+		pthread_create(&consumers[i], NULL, consumer, (void*)i);
+	for (i = 0; i < PRODUCERS; i++)
+		pthread_create(&producers[i], NULL, producer, (void*)i);
+	for (i = 0; i < PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+	for (i = 0; i < CONSUMERS; i++)
+		pthread_join(consumers[i], NULL);
+
+	for (p = 0; p < PRODUCERS; p++) {
+		for (seq = 1; seq <= ITEMS; seq++)
+			ok = ok && atomic_load(&seen[p][seq]) == 1;
+	}
+	TEST_ASSERT(atomic_load(&consumed) == PRODUCERS * ITEMS);
+	TEST_ASSERT(ok);
+	TEST_ASSERT(atomic_load(&order_errors) == 0);
+	TEST_ASSERT(cqueue_destroy(cq) == 0);
+}
+
+int main(void)
+{
+	test_bounds();
+	test_stress();
+	return 0;
+}
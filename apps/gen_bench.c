@@ -0,0 +1,161 @@
+/*
+ * Generator test and benchmark
+ *
+ * Checks that values travel both ways between a consumer and its generators,
+ * including nested generators, then compares the cost of pulling values out of
+ * a generator with handing them to a callback. Prints the average cost of one
+ * value, in nanoseconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+/* Number of values of the benchmark */
+#define VALUES 1000000
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* yield the integers from 0 to arg - 1, return their count */
+static void *count(uthread_gen_t gen, void *arg)
+{
+	long i, n = (long)arg;
+
+	for (i = 0; i < n; i++)
+		uthread_gen_yield(gen, (void*)i);
+
+	return (void*)n;
+}
+
+/* add every value sent by the consumer to a running total and yield it */
+static void *accumulate(uthread_gen_t gen, void *arg)
+{
+	long total = 0;
+	void *in;
+
+	(void)arg;
+	in = uthread_gen_yield(gen, (void*)total);
+	while (in != NULL) {
+		total += (long)in;
+		in = uthread_gen_yield(gen, (void*)total);
+	}
+
+	return (void*)-1L;
+}
+
+/* yield the squares of the values of a nested generator */
+static void *squares(uthread_gen_t gen, void *arg)
+{
+	uthread_gen_t inner = uthread_gen_create(count, arg);
+	void *value;
+
+	while (uthread_gen_next(inner, NULL, &value) == 1)
+		uthread_gen_yield(gen, (void*)((long)value * (long)value));
+	uthread_gen_destroy(inner);
+
+	return NULL;
+}
+
+static void add(long value, void *arg)
+{
+	*(long*)arg += value;
+}
+
+/* called through a pointer the compiler cannot see through, like a real API */
+static void (*volatile callback)(long, void*) = add;
+
+static void callback_count(long n, void *arg)
+{
+	for (long i = 0; i < n; i++)
+		callback(i, arg);
+}
+
+static void test_generators(void)
+{
+	uthread_gen_t gen;
+	void *value;
+	long sum = 0;
+	int ret;
+
+	gen = uthread_gen_create(count, (void*)10L);
+	while ((ret = uthread_gen_next(gen, NULL, &value)) == 1)
+		sum += (long)value;
+	TEST_ASSERT(ret == 0 && (long)value == 10 && sum == 45);
+	TEST_ASSERT(uthread_gen_next(gen, NULL, &value) == -1);
+	uthread_gen_destroy(gen);
+
+	/* values sent by the consumer */
+	gen = uthread_gen_create(accumulate, NULL);
+	uthread_gen_next(gen, NULL, &value);
+	uthread_gen_next(gen, (void*)5L, &value);
+	uthread_gen_next(gen, (void*)7L, &value);
+	TEST_ASSERT((long)value == 12);
+	TEST_ASSERT(uthread_gen_next(gen, NULL, &value) == 0 && (long)value == -1);
+	uthread_gen_destroy(gen);
+
+	sum = 0;
+	gen = uthread_gen_create(squares, (void*)4L);
+	while (uthread_gen_next(gen, NULL, &value) == 1)
+		sum += (long)value;
+	TEST_ASSERT(sum == 0 + 1 + 4 + 9);
+	uthread_gen_destroy(gen);
+
+	/* an unfinished generator can be destroyed */
+	gen = uthread_gen_create(count, (void*)10L);
+	uthread_gen_next(gen, NULL, &value);
+	TEST_ASSERT(uthread_gen_destroy(gen) == 0);
+	TEST_ASSERT(uthread_gen_create(NULL, NULL) == NULL);
+}
+
+static void bench(void)
+{
+	uthread_gen_t gen;
+	void *value;
+	long gen_sum = 0, callback_sum = 0;
+	double start, mid, end;
+
+	start = now();
+	gen = uthread_gen_create(count, (void*)(long)VALUES);
+	while (uthread_gen_next(gen, NULL, &value) == 1)
+		gen_sum += (long)value;
+	uthread_gen_destroy(gen);
+	mid = now();
+	callback_count(VALUES, &callback_sum);
+	end = now();
+
+	if (gen_sum != callback_sum)
+		exit(1);
+
+	printf("generator: %6.1f ns/value\n", (mid - start) / VALUES);
+	printf("callback:  %6.1f ns/value\n", (end - mid) / VALUES);
+}
+
+int main(void)
+{
+	uthread_start(0);
+
+	test_generators();
+	bench();
+
+	uthread_stop();
+	return 0;
+}
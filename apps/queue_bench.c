@@ -0,0 +1,149 @@
+/*
+ * Queue backend benchmark
+ *
+ * Compares the linked list and ring buffer backends of the queue API on the
+ * operations the scheduler relies on. Prints the average cost of one
+ * operation, in nanoseconds, for each backend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <queue.h>
+
+/* Number of items of the bulk tests */
+#define ITEMS 1000000
+/* Number of items in the queue during the steady state test */
+#define WINDOW 64
+/* Number of operations of the steady state test */
+#define ROUNDS 10000000
+/* Number of passes of the iterate test */
+#define PASSES 20
+/* Number of items per call of the batch test, like a broadcast wakeup */
+#define BATCH 64
+
+static long items[ITEMS];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Callback func: sum the items */
+static int sum_item(queue_t q, void *data, void *arg)
+{
+	(void)q;
+	*(long*)arg += *(long*)data;
+	return 0;
+}
+
+/* Enqueue ITEMS items, then dequeue them all */
+static void bench_bulk(queue_backend_t backend, const char *name)
+{
+	queue_t q = queue_create_backend(backend);
+	void *ptr;
+	double start, mid, end;
+	int i;
+
+	start = now();
+	for (i = 0; i < ITEMS; i++)
+		queue_enqueue(q, &items[i]);
+	mid = now();
+	for (i = 0; i < ITEMS; i++)
+		queue_dequeue(q, &ptr);
+	end = now();
+
+	printf("%-6s enqueue %8.2f ns/op\n", name, (mid - start) / ITEMS);
+	printf("%-6s dequeue %8.2f ns/op\n", name, (end - mid) / ITEMS);
+	queue_destroy(q);
+}
+
+/* Same as bench_bulk() in batches of BATCH items */
+static void bench_batch(queue_backend_t backend, const char *name)
+{
+	queue_t q = queue_create_backend(backend);
+	void *batch[BATCH];
+	double start, mid, end;
+	int i, j;
+
+	start = now();
+	for (i = 0; i < ITEMS; i += BATCH) {
+		for (j = 0; j < BATCH; j++)
+			batch[j] = &items[(i + j) % ITEMS];
+		queue_enqueue_batch(q, batch, BATCH);
+	}
+	mid = now();
+	while (queue_dequeue_batch(q, batch, BATCH) > 0);
+	end = now();
+
+	printf("%-6s enqueue_batch %8.2f ns/item\n", name, (mid - start) / ITEMS);
+	printf("%-6s dequeue_batch %8.2f ns/item\n", name, (end - mid) / ITEMS);
+	queue_destroy(q);
+}
+
+/* Rotate a queue of WINDOW items, like the ready queue on yield */
+static void bench_steady(queue_backend_t backend, const char *name)
+{
+	queue_t q = queue_create_backend(backend);
+	void *ptr;
+	double start, end;
+	int i;
+
+	for (i = 0; i < WINDOW; i++)
+		queue_enqueue(q, &items[i]);
+
+	start = now();
+	for (i = 0; i < ROUNDS; i++) {
+		queue_dequeue(q, &ptr);
+		queue_enqueue(q, ptr);
+	}
+	end = now();
+
+	printf("%-6s rotate  %8.2f ns/op\n", name, (end - start) / ROUNDS);
+	while (queue_dequeue(q, &ptr) == 0);
+	queue_destroy(q);
+}
+
+/* Iterate over ITEMS items */
+static void bench_iterate(queue_backend_t backend, const char *name)
+{
+	queue_t q = queue_create_backend(backend);
+	void *ptr;
+	double start, end;
+	long sum = 0;
+	int i;
+
+	for (i = 0; i < ITEMS; i++)
+		queue_enqueue(q, &items[i]);
+
+	start = now();
+	for (i = 0; i < PASSES; i++)
+		queue_iterate(q, sum_item, &sum, NULL);
+	end = now();
+
+	printf("%-6s iterate %8.2f ns/item (sum %ld)\n", name,
+	       (end - start) / ((double)ITEMS * PASSES), sum);
+	while (queue_dequeue(q, &ptr) == 0);
+	queue_destroy(q);
+}
+
+int main(void)
+{
+	for (int i = 0; i < ITEMS; i++)
+		items[i] = i;
+
+	bench_bulk(QUEUE_LIST, "list");
+	bench_bulk(QUEUE_RING, "ring");
+	bench_batch(QUEUE_LIST, "list");
+	bench_batch(QUEUE_RING, "ring");
+	bench_steady(QUEUE_LIST, "list");
+	bench_steady(QUEUE_RING, "ring");
+	bench_iterate(QUEUE_LIST, "list");
+	bench_iterate(QUEUE_RING, "ring");
+
+	return 0;
+}
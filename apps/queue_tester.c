@@ -15,12 +15,16 @@ do {									\
 	}									\
 } while(0)
 
+/* Backend of the queues created by the tests */
+static queue_backend_t backend;
+
 /* Create */
 void test_create(void)
 {
 	fprintf(stderr, "*** TEST create ***\n");
 
 	TEST_ASSERT(queue_create() != NULL);
+	TEST_ASSERT(queue_create_backend(backend) != NULL);
 }
 
 /* Enqueue/Dequeue simple */
@@ -31,7 +35,7 @@ void test_queue_simple(void)
 
 	fprintf(stderr, "*** TEST queue_simple ***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &data);
 	queue_dequeue(q, (void**)&ptr);
 	TEST_ASSERT(ptr == &data);
@@ -47,7 +51,7 @@ void test_delete_1(void)
 
 	fprintf(stderr, "*** TEST delete 1***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &unmatch);
 	queue_enqueue(q, &matchOld);
 	queue_enqueue(q, &matchYoung);
@@ -67,7 +71,7 @@ void test_delete_2(void)
 
 	fprintf(stderr, "*** TEST delete 2***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &unmatch);
 	queue_enqueue(q, &matchOld);
 	queue_enqueue(q, &matchYoung);
@@ -87,7 +91,7 @@ void test_delete_3(void)
 
 	fprintf(stderr, "*** TEST delete 3***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &unmatch);
 	queue_enqueue(q, &matchOld);
 	queue_enqueue(q, &matchYoung);
@@ -123,7 +127,7 @@ void test_iterate(void)
 	fprintf(stderr, "*** TEST iterate ***\n");
 
 	/* Initialize the queue and enqueue items */
-	q = queue_create();
+	q = queue_create_backend(backend);
 	for (i = 0; i < sizeof(testData) / sizeof(testData[0]); i++)
 		queue_enqueue(q, &testData[i]);
 
@@ -142,7 +146,7 @@ void test_en_dequeue_1(void)
 
 	fprintf(stderr, "*** TEST enqueue/dequeue 1***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &data[0]);
 	queue_enqueue(q, &data[1]);
 	queue_enqueue(q, &data[1]);
@@ -158,7 +162,7 @@ void test_en_dequeue_2(void)
 
 	fprintf(stderr, "*** TEST enqueue/dequeue 2***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &data[0]);
 	queue_enqueue(q, &data[1]);
 	queue_dequeue(q, (void**)&ptr);
@@ -175,7 +179,7 @@ void test_en_dequeue_3(void)
 
 	fprintf(stderr, "*** TEST enqueue/dequeue 3***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &data[0]);
 	queue_enqueue(q, &data[1]);
 	queue_dequeue(q, (void**)&ptr);
@@ -193,7 +197,7 @@ void test_en_dequeue_4(void)
 
 	fprintf(stderr, "*** TEST enqueue/dequeue 4***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &data[0]);
 	queue_enqueue(q, &data[1]);
 	queue_dequeue(q, (void**)&ptr);
@@ -216,7 +220,7 @@ void test_error_1(void)
 
 	fprintf(stderr, "*** TEST error handle 1***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &data[0]);
 	queue_dequeue(q, (void**)&ptr);
 
@@ -231,7 +235,7 @@ void test_error_2(void)
 
 	fprintf(stderr, "*** TEST error handle 2***\n");
 
-	q = queue_create();
+	q = queue_create_backend(backend);
 	queue_enqueue(q, &data[0]);
 	queue_dequeue(q, (void**)&ptr);
 
@@ -239,7 +243,242 @@ void test_error_2(void)
 }
 
 
-int main(void)
+/* Ring growth keeps FIFO order when the items wrap around */
+void test_wrap(void)
+{
+	int data[100], *ptr;
+	int i, ok = 1;
+	queue_t q;
+
+	fprintf(stderr, "*** TEST wrap ***\n");
+
+	q = queue_create_backend(backend);
+	for (i = 0; i < 10; i++)
+		queue_enqueue(q, &data[i]);
+	for (i = 0; i < 5; i++)
+		queue_dequeue(q, (void**)&ptr);
+	for (i = 10; i < 100; i++)
+		queue_enqueue(q, &data[i]);
+	for (i = 5; i < 100; i++) {
+		queue_dequeue(q, (void**)&ptr);
+		ok = ok && ptr == &data[i];
+	}
+	TEST_ASSERT(ok);
+	TEST_ASSERT(queue_length(q) == 0);
+	TEST_ASSERT(queue_destroy(q) == 0);
+}
+
+/* Callback func: delete every item */
+static int del_item(queue_t q, void *data, void *arg)
+{
+	(void)arg;
+	queue_delete(q, data);
+	return 0;
+}
+
+/* Iterate while deleting every item */
+void test_iterate_delete(void)
+{
+	int data[5] = {0,1,2,3,4};
+	size_t i;
+	queue_t q;
+
+	fprintf(stderr, "*** TEST iterate delete ***\n");
+
+	q = queue_create_backend(backend);
+	for (i = 0; i < 5; i++)
+		queue_enqueue(q, &data[i]);
+	queue_iterate(q, del_item, NULL, NULL);
+	TEST_ASSERT(queue_length(q) == 0);
+}
+
+/* Delete the newest item, then keep using the queue */
+void test_delete_last(void)
+{
+	int data[5] = {0,1,2,3,4}, *ptr;
+	int i, ok = 1;
+	queue_t q;
+
+	fprintf(stderr, "*** TEST delete last ***\n");
+
+	q = queue_create_backend(backend);
+	for (i = 0; i < 4; i++)
+		queue_enqueue(q, &data[i]);
+	TEST_ASSERT(queue_delete(q, &data[3]) == 0);
+	TEST_ASSERT(queue_delete(q, &data[1]) == 0);
+	TEST_ASSERT(queue_delete(q, &data[2]) == 0);
+	TEST_ASSERT(queue_length(q) == 1);
+	queue_enqueue(q, &data[4]);
+	queue_dequeue(q, (void**)&ptr);
+	ok = ok && ptr == &data[0];
+	queue_dequeue(q, (void**)&ptr);
+	ok = ok && ptr == &data[4];
+	TEST_ASSERT(ok);
+	TEST_ASSERT(queue_destroy(q) == 0);
+}
+
+/* Enqueue and dequeue items in batches, wrapping around the ring */
+void test_batch(void)
+{
+	int data[100], *ptr;
+	void *items[100];
+	int i, ok = 1;
+	queue_t q;
+
+	fprintf(stderr, "*** TEST batch ***\n");
+
+	for (i = 0; i < 100; i++)
+		items[i] = &data[i];
+
+	q = queue_create_backend(backend);
+	TEST_ASSERT(queue_enqueue_batch(q, items, 10) == 0);
+	TEST_ASSERT(queue_dequeue_batch(q, items + 50, 6) == 6);
+	TEST_ASSERT(queue_enqueue_batch(q, items + 10, 40) == 0);
+	TEST_ASSERT(queue_length(q) == 44);
+	for (i = 0; i < 6; i++)
+		ok = ok && items[50 + i] == &data[i];
+	TEST_ASSERT(queue_dequeue_batch(q, items + 50, 20) == 20);
+	for (i = 0; i < 20; i++)
+		ok = ok && items[50 + i] == &data[6 + i];
+	queue_dequeue(q, (void**)&ptr);
+	ok = ok && ptr == &data[26];
+	TEST_ASSERT(ok);
+
+	/* a NULL item rejects the whole batch */
+	items[0] = NULL;
+	TEST_ASSERT(queue_enqueue_batch(q, items, 5) == -1);
+	TEST_ASSERT(queue_length(q) == 23);
+	TEST_ASSERT(queue_enqueue_batch(q, items, 0) == 0);
+
+	/* no more items than the queue holds */
+	TEST_ASSERT(queue_dequeue_batch(q, items + 50, 50) == 23);
+	TEST_ASSERT(items[50] == &data[27] && items[72] == &data[49]);
+	TEST_ASSERT(queue_dequeue_batch(q, items + 50, 50) == 0);
+	TEST_ASSERT(queue_destroy(q) == 0);
+}
+
+/* Splice a queue of each backend into a queue of the current backend */
+void test_splice(void)
+{
+	queue_backend_t backends[] = { QUEUE_LIST, QUEUE_RING };
+	int data[40], *ptr;
+	int i, b, ok = 1;
+	queue_t dst, src;
+
+	fprintf(stderr, "*** TEST splice ***\n");
+
+	for (b = 0; b < 2; b++) {
+		dst = queue_create_backend(backend);
+		src = queue_create_backend(backends[b]);
+		for (i = 0; i < 20; i++)
+			queue_enqueue(dst, &data[i]);
+		/* wrap the ring around */
+		for (i = 0; i < 4; i++)
+			queue_enqueue(src, &data[i]);
+		for (i = 0; i < 4; i++)
+			queue_dequeue(src, (void**)&ptr);
+		for (i = 20; i < 40; i++)
+			queue_enqueue(src, &data[i]);
+
+		TEST_ASSERT(queue_splice(dst, src) == 0);
+		TEST_ASSERT(queue_length(src) == 0);
+		TEST_ASSERT(queue_length(dst) == 40);
+		for (i = 0; i < 40; i++) {
+			queue_dequeue(dst, (void**)&ptr);
+			ok = ok && ptr == &data[i];
+		}
+		TEST_ASSERT(ok);
+
+		/* both queues are still usable */
+		queue_enqueue(src, &data[0]);
+		TEST_ASSERT(queue_splice(dst, src) == 0);
+		TEST_ASSERT(queue_splice(dst, src) == 0);
+		TEST_ASSERT(queue_splice(dst, dst) == -1);
+		queue_dequeue(dst, (void**)&ptr);
+		TEST_ASSERT(ptr == &data[0]);
+		TEST_ASSERT(queue_destroy(dst) == 0);
+		TEST_ASSERT(queue_destroy(src) == 0);
+	}
+}
+
+/* Callback func: remove the handle passed in @arg, once */
+static int remove_next(queue_t q, void *data, void *arg)
+{
+	queue_node_t *node = arg;
+
+	(void)data;
+	if (*node != NULL) {
+		queue_remove_node(q, *node);
+		*node = NULL;
+	}
+	return 0;
+}
+
+/* Callback func: count the items */
+static int count_item(queue_t q, void *data, void *arg)
+{
+	(void)q;
+	(void)data;
+	(*(int*)arg)++;
+	return 0;
+}
+
+/* Remove items of a list by handle, wherever they are */
+void test_remove_node(void)
+{
+	int data[6] = {0,1,2,3,4,5}, *ptr;
+	queue_node_t nodes[6];
+	void *items[6];
+	int i, count = 0;
+	queue_t q, other;
+
+	fprintf(stderr, "*** TEST remove node ***\n");
+
+	q = queue_create();
+	for (i = 0; i < 6; i++)
+		TEST_ASSERT(queue_enqueue_node(q, &data[i], &nodes[i]) == 0);
+	TEST_ASSERT(queue_remove_node(q, nodes[2]) == 0);
+	TEST_ASSERT(queue_remove_node(q, nodes[0]) == 0);
+	TEST_ASSERT(queue_remove_node(q, nodes[5]) == 0);
+	TEST_ASSERT(queue_length(q) == 3);
+	queue_enqueue(q, &data[5]);
+	queue_dequeue(q, (void**)&ptr);
+	TEST_ASSERT(ptr == &data[1]);
+
+	/* the handles follow their items into another list */
+	other = queue_create();
+	TEST_ASSERT(queue_splice(other, q) == 0);
+	TEST_ASSERT(queue_remove_node(other, nodes[4]) == 0);
+	queue_dequeue(other, (void**)&ptr);
+	TEST_ASSERT(ptr == &data[3]);
+	queue_dequeue(other, (void**)&ptr);
+	TEST_ASSERT(ptr == &data[5]);
+
+	/* a handle is refused by any queue but the one holding its item */
+	TEST_ASSERT(queue_enqueue_node(other, &data[4], &nodes[4]) == 0);
+	TEST_ASSERT(queue_enqueue_node(q, &data[0], &nodes[0]) == 0);
+	TEST_ASSERT(queue_remove_node(q, nodes[4]) == -1);
+	TEST_ASSERT(queue_remove_node(other, nodes[0]) == -1);
+	TEST_ASSERT(queue_length(q) == 1 && queue_length(other) == 1);
+	TEST_ASSERT(queue_remove_node(other, nodes[4]) == 0);
+	TEST_ASSERT(queue_remove_node(q, nodes[0]) == 0);
+
+	/* an item removed before being visited is skipped */
+	for (i = 0; i < 4; i++)
+		queue_enqueue_node(q, &data[i], &nodes[i]);
+	queue_iterate(q, remove_next, &nodes[1], NULL);
+	queue_iterate(q, count_item, &count, NULL);
+	TEST_ASSERT(count == 3);
+	TEST_ASSERT(queue_dequeue_batch(q, items, 6) == 3);
+	TEST_ASSERT(items[1] == &data[2]);
+
+	/* items of a ring have no handle */
+	TEST_ASSERT(queue_enqueue_node(queue_create_backend(QUEUE_RING),
+				       &data[0], &nodes[0]) == -1);
+}
+
+/* Run every test with the current backend */
+void test_backend(void)
 {
 	test_create();
 	test_queue_simple();
@@ -253,5 +492,23 @@ int main(void)
 	test_en_dequeue_4();
 	test_error_1();
 	test_error_2();
+	test_wrap();
+	test_delete_last();
+	test_batch();
+	test_splice();
+	test_iterate_delete();
+}
+
+int main(void)
+{
+	fprintf(stderr, "*** BACKEND list ***\n");
+	backend = QUEUE_LIST;
+	test_backend();
+	test_remove_node();
+
+	fprintf(stderr, "*** BACKEND ring ***\n");
+	backend = QUEUE_RING;
+	test_backend();
+
 	return 0;
 }
@@ -0,0 +1,64 @@
+/*
+ * CPU affinity test
+ *
+ * Pins the scheduler and the offload helpers to the first CPU the process may
+ * run on, then checks that both the scheduler and offloaded calls run there.
+ * Invalid CPU lists must be rejected.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+static void *where(void *arg)
+{
+	(void)arg;
+	return (void*)(long)sched_getcpu();
+}
+
+int thread(void)
+{
+	return sched_getcpu();
+}
+
+int main(void)
+{
+	cpu_set_t allowed;
+	int bad[] = { -1 };
+	int cpu = 0, retval;
+	void *helper_cpu;
+
+	/* the first CPU the process is allowed on */
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	while (!CPU_ISSET(cpu, &allowed))
+		cpu++;
+
+	TEST_ASSERT(uthread_affinity_config(NULL, 1) == -1);
+	TEST_ASSERT(uthread_affinity_config(bad, 1) == -1);
+	TEST_ASSERT(uthread_affinity_config(&cpu, 1) == 0);
+
+	uthread_start(0);
+
+	uthread_join(uthread_create(thread), &retval);
+	TEST_ASSERT(retval == cpu);
+
+	uthread_offload(where, NULL, &helper_cpu);
+	TEST_ASSERT((long)helper_cpu == cpu);
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Arena allocator test
+ *
+ * Threads fill many small arena allocations with their own pattern while
+ * yielding to each other, and check that nothing was overwritten. Chunks
+ * released by exited threads must be reused by later threads. Prints the
+ * average cost of an allocation against malloc() and free().
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define THREADS 4
+#define OBJECTS 500
+/* Number of allocations of the benchmark */
+#define ALLOCS 1000000
+
+static void *first_alloc[2];
+static int generation;
+static int errors;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int filler(void)
+{
+	unsigned char *objects[OBJECTS];
+	size_t sizes[OBJECTS];
+	int self = uthread_self();
+	int i;
+
+	for (i = 0; i < OBJECTS; i++) {
+		sizes[i] = 1 + (i * 37) % 200;
+		/* some allocations get a chunk of their own */
+		if (i % 100 == 0)
+			sizes[i] = 10000;
+		objects[i] = uthread_arena_alloc(sizes[i]);
+		if (objects[i] == NULL || (uintptr_t)objects[i] % 16 != 0)
+			errors++;
+		memset(objects[i], self, sizes[i]);
+		if (i % 50 == 0)
+			uthread_yield();
+	}
+
+	for (i = 0; i < OBJECTS; i++) {
+		for (size_t j = 0; j < sizes[i]; j++) {
+			if (objects[i][j] != (unsigned char)self)
+				errors++;
+		}
+	}
+
+	return 0;
+}
+
+int first(void)
+{
+	first_alloc[generation] = uthread_arena_alloc(8);
+	return 0;
+}
+
+int bench(void)
+{
+	static void *ptrs[ALLOCS];
+	double start, mid, end;
+	int i;
+
+	start = now();
+	for (i = 0; i < ALLOCS; i++)
+		ptrs[i] = uthread_arena_alloc(48);
+	mid = now();
+	for (i = 0; i < ALLOCS; i++)
+		ptrs[i] = malloc(48);
+	for (i = 0; i < ALLOCS; i++)
+		free(ptrs[i]);
+	end = now();
+
+	printf("arena:  %5.1f ns/alloc\n", (mid - start) / ALLOCS);
+	printf("malloc: %5.1f ns/alloc\n", (end - mid) / ALLOCS);
+
+	return 0;
+}
+
+int main(void)
+{
+	uthread_t tids[THREADS];
+	int i;
+
+	uthread_start(0);
+
+	TEST_ASSERT(uthread_arena_alloc(0) == NULL);
+	TEST_ASSERT(uthread_arena_alloc(SIZE_MAX) == NULL);
+	TEST_ASSERT(uthread_arena_alloc(SIZE_MAX - 8) == NULL);
+
+	for (i = 0; i < THREADS; i++)
+		tids[i] = uthread_create(filler);
+	uthread_join_all(tids, THREADS, NULL);
+	TEST_ASSERT(errors == 0);
+
+	/* the chunk of an exited thread goes to the next one */
+	uthread_join(uthread_create(first), NULL);
+	generation++;
+	uthread_join(uthread_create(first), NULL);
+	TEST_ASSERT(first_alloc[0] == first_alloc[1]);
+
+	uthread_join(uthread_create(bench), NULL);
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Cancellation test
+ *
+ * Threads are cancelled while they sleep, wait for a file descriptor, join
+ * another thread, wait for a future or for an offloaded call. They must exit
+ * at once with UTHREAD_CANCELED after running their cleanup handlers, and a
+ * cancellation must reach all the threads they created, even down a chain of
+ * thousands of generations cancelled from a thread stack. With preemption, a
+ * thread cancelled while computing keeps running until it reaches a
+ * cancellation point.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+/* Number of generations of the chain of threads */
+#define CHAIN 2000
+
+static int cleanups;
+static int order[2];
+static int pipe_fds[2];
+static uthread_t child_tid, grandchild_tid;
+static volatile int computed;
+static uthread_t chain[CHAIN];
+static int chain_length;
+
+static void cleanup(void *arg)
+{
+	order[cleanups % 2] = (int)(long)arg;
+	cleanups++;
+}
+
+int sleeper(void)
+{
+	uthread_cleanup_push(cleanup, (void*)1L);
+	uthread_cleanup_push(cleanup, (void*)2L);
+	uthread_sleep(10000000);
+	return 0;
+}
+
+int reader(void)
+{
+	uthread_wait_fd(pipe_fds[0], 0x001);
+	return 0;
+}
+
+int spinner(void)
+{
+	while (1)
+		uthread_yield();
+	return 0;
+}
+
+/* compute for 100 ms, across several preemptions, then test cancellation */
+int computer(void)
+{
+	struct timespec ts, now;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((now.tv_sec - ts.tv_sec) * 1000000000L +
+		 now.tv_nsec - ts.tv_nsec < 100000000L);
+
+	computed = 1;
+	uthread_testcancel();
+	return 0;
+}
+
+int child(void)
+{
+	grandchild_tid = uthread_create(spinner);
+	return uthread_join(grandchild_tid, NULL);
+}
+
+int parent(void)
+{
+	child_tid = uthread_create(child);
+	return uthread_join(child_tid, NULL);
+}
+
+/* each generation creates the next one, then sleeps */
+int chain_link(void)
+{
+	if (chain_length < CHAIN) {
+		int i = chain_length++;
+
+		chain[i] = uthread_create(chain_link);
+	}
+	uthread_sleep(10000000);
+	return 0;
+}
+
+int chain_canceller(void)
+{
+	return uthread_cancel(chain[0]);
+}
+
+static void *slow_call(void *arg)
+{
+	struct timespec ts = {0, 100000000};
+
+	nanosleep(&ts, NULL);
+	return arg;
+}
+
+static void destroy_future(void *future)
+{
+	uthread_future_destroy(future);
+}
+
+int future_waiter(void)
+{
+	uthread_future_t future = uthread_async(slow_call, NULL);
+
+	uthread_cleanup_push(destroy_future, future);
+	uthread_future_get(future, NULL);
+	return 0;
+}
+
+int offloader(void)
+{
+	uthread_offload(slow_call, NULL, NULL);
+	return 0;
+}
+
+int popper(void)
+{
+	uthread_cleanup_push(cleanup, (void*)3L);
+	uthread_cleanup_pop(1);
+	uthread_cleanup_push(cleanup, (void*)4L);
+	uthread_cleanup_pop(0);
+	return 7;
+}
+
+/* create a thread, let it block, cancel it and return its return value */
+static int cancel_blocked(uthread_func_t func)
+{
+	int retval;
+	uthread_t tid = uthread_create(func);
+
+	uthread_yield();
+	uthread_cancel(tid);
+	uthread_join(tid, &retval);
+
+	return retval;
+}
+
+int main(void)
+{
+	int retval, i, canceled = 0;
+	uthread_t tid;
+
+	uthread_start(0);
+
+	/* handlers run from the last pushed */
+	TEST_ASSERT(cancel_blocked(sleeper) == UTHREAD_CANCELED);
+	TEST_ASSERT(cleanups == 2 && order[0] == 2 && order[1] == 1);
+
+	if (pipe(pipe_fds) != 0)
+		exit(1);
+	TEST_ASSERT(cancel_blocked(reader) == UTHREAD_CANCELED);
+
+	TEST_ASSERT(cancel_blocked(future_waiter) == UTHREAD_CANCELED);
+	TEST_ASSERT(cancel_blocked(offloader) == UTHREAD_CANCELED);
+
+	/* the descendants of a cancelled thread are cancelled too */
+	tid = uthread_create(parent);
+	uthread_yield();
+	uthread_yield();
+	TEST_ASSERT(uthread_cancel(tid) == 0);
+	uthread_join(tid, &retval);
+	TEST_ASSERT(retval == UTHREAD_CANCELED);
+	uthread_join(child_tid, &retval);
+	TEST_ASSERT(retval == UTHREAD_CANCELED);
+	uthread_join(grandchild_tid, &retval);
+	TEST_ASSERT(retval == UTHREAD_CANCELED);
+
+	/* the cancellation walks down the chain from a thread stack */
+	chain[chain_length++] = uthread_create(chain_link);
+	while (chain_length < CHAIN)
+		uthread_yield();
+	tid = uthread_create(chain_canceller);
+	uthread_join(tid, &retval);
+	TEST_ASSERT(retval == 0);
+	for (i = 0; i < CHAIN; i++) {
+		uthread_join(chain[i], &retval);
+		if (retval == UTHREAD_CANCELED)
+			canceled++;
+	}
+	TEST_ASSERT(canceled == CHAIN);
+
+	/* popped handlers run only if asked to */
+	cleanups = 0;
+	tid = uthread_create(popper);
+	uthread_join(tid, &retval);
+	TEST_ASSERT(retval == 7 && cleanups == 1 && order[0] == 3);
+
+	TEST_ASSERT(uthread_cancel(0) == -1);
+	TEST_ASSERT(uthread_cancel(tid) == -1);
+
+	uthread_stop();
+
+	/* preempted, the thread is cancelled while computing */
+	uthread_start(1);
+	tid = uthread_create(computer);
+	uthread_yield();
+	TEST_ASSERT(uthread_cancel(tid) == 0);
+	uthread_join(tid, &retval);
+	TEST_ASSERT(retval == UTHREAD_CANCELED && computed);
+
+	uthread_stop();
+	return 0;
+}
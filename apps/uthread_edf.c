@@ -0,0 +1,134 @@
+/*
+ * Earliest-deadline-first test
+ *
+ * Threads with deadlines woken up together must run in deadline order, ahead
+ * of best-effort threads. With preemption, a thread with a deadline waking up
+ * from a sleep must take the CPU from a best-effort thread which never yields,
+ * without waiting for a timer tick. Deadline outcomes are counted.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+static int gate;
+static int order[4], ran;
+static volatile int woke;
+static double lateness_ms;
+
+static double clock_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* deadline in ms, given by the order of creation */
+static int edf_thread(unsigned long deadline_ms)
+{
+	uthread_set_deadline(deadline_ms * 1000);
+	while (gate == 0)
+		uthread_park(&gate, 0);
+	order[ran++] = deadline_ms;
+	return 0;
+}
+
+int late(void)
+{
+	return edf_thread(300);
+}
+
+int early(void)
+{
+	return edf_thread(100);
+}
+
+int middle(void)
+{
+	return edf_thread(200);
+}
+
+int best_effort(void)
+{
+	while (gate == 0)
+		uthread_park(&gate, 0);
+	order[ran++] = 0;
+	return 0;
+}
+
+/* best-effort thread which never gives the CPU up on its own */
+int hog(void)
+{
+	double end = clock_ms() + 1000;
+
+	while (!woke && clock_ms() < end)
+		;
+	return 0;
+}
+
+int sleeper(void)
+{
+	double wake;
+
+	uthread_set_deadline(50000);
+	wake = clock_ms() + 5;
+	uthread_sleep(5000);
+	lateness_ms = clock_ms() - wake;
+	woke = 1;
+	return 0;
+}
+
+int main(void)
+{
+	uthread_t tids[4];
+	struct uthread_stats stats;
+
+	uthread_start(1);
+
+	tids[0] = uthread_create(best_effort);
+	tids[1] = uthread_create(late);
+	tids[2] = uthread_create(early);
+	tids[3] = uthread_create(middle);
+	/* let all of them park */
+	uthread_yield();
+
+	gate = 1;
+	uthread_unpark(&gate, INT_MAX);
+	uthread_join_all(tids, 4, NULL);
+	TEST_ASSERT(order[0] == 100 && order[1] == 200 && order[2] == 300);
+	TEST_ASSERT(order[3] == 0);
+
+	uthread_get_stats(&stats);
+	TEST_ASSERT(stats.deadlines_met == 3 && stats.deadlines_missed == 0);
+
+	tids[0] = uthread_create(sleeper);
+	tids[1] = uthread_create(hog);
+	uthread_join_all(tids, 2, NULL);
+	printf("woken %.2f ms late\n", lateness_ms);
+	TEST_ASSERT(woke && lateness_ms < 3);
+
+	/* a deadline which passed is missed */
+	uthread_set_deadline(100);
+	uthread_sleep(1000);
+	uthread_set_deadline(0);
+	uthread_get_stats(&stats);
+	TEST_ASSERT(stats.deadlines_met == 4 && stats.deadlines_missed == 1);
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Executor test
+ *
+ * Jobs are submitted faster than they complete. The executor must never run
+ * more threads than its maximum, the submitter must be parked while the
+ * pending queue is full, and the try variant must reject jobs instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define THREADS 4
+#define PENDING 8
+#define JOBS 100
+
+static int running, running_max, done;
+
+static void *sleeper(void *arg)
+{
+	if (++running > running_max)
+		running_max = running;
+	uthread_sleep((long)arg);
+	running--;
+	done++;
+	return NULL;
+}
+
+/* ends its thread, the executor must carry on with another thread */
+static void *quitter(void *arg)
+{
+	(void)arg;
+	done++;
+	uthread_exit(0);
+	return NULL;
+}
+
+void test_bounded(void)
+{
+	uthread_exec_t exec = uthread_exec_create(THREADS, PENDING);
+	struct uthread_exec_stats stats;
+	int i;
+
+	fprintf(stderr, "*** TEST bounded ***\n");
+
+	done = 0;
+	for (i = 0; i < JOBS; i++)
+		uthread_exec_submit(exec, sleeper, (void*)1000L);
+
+	/* the last jobs are still queued */
+	uthread_exec_get_stats(exec, &stats);
+	TEST_ASSERT(stats.running == THREADS && stats.pending <= PENDING);
+	TEST_ASSERT(stats.pending_peak == PENDING && stats.submitted == JOBS);
+
+	uthread_exec_destroy(exec);
+	TEST_ASSERT(done == JOBS && running_max == THREADS);
+}
+
+void test_reject(void)
+{
+	uthread_exec_t exec = uthread_exec_create(1, 2);
+	struct uthread_exec_stats stats;
+	int accepted = 0;
+
+	fprintf(stderr, "*** TEST reject ***\n");
+
+	done = 0;
+	for (int i = 0; i < 5; i++)
+		accepted += uthread_exec_try_submit(exec, sleeper,
+						    (void*)1000L) == 0;
+	uthread_exec_get_stats(exec, &stats);
+	TEST_ASSERT(accepted == 3 && stats.rejected == 2);
+
+	/* room is made as jobs complete */
+	uthread_sleep(1500);
+	TEST_ASSERT(uthread_exec_try_submit(exec, sleeper, (void*)1000L) == 0);
+
+	uthread_exec_destroy(exec);
+	TEST_ASSERT(done == 4);
+}
+
+void test_exit(void)
+{
+	uthread_exec_t exec = uthread_exec_create(1, 4);
+	struct uthread_exec_stats stats;
+
+	fprintf(stderr, "*** TEST exit ***\n");
+
+	done = 0;
+	uthread_exec_submit(exec, quitter, NULL);
+	for (int i = 0; i < 4; i++)
+		uthread_exec_submit(exec, quitter, NULL);
+	uthread_exec_get_stats(exec, &stats);
+	TEST_ASSERT(stats.running == 1 && stats.pending == 4);
+
+	uthread_exec_destroy(exec);
+	TEST_ASSERT(done == 5);
+
+	TEST_ASSERT(uthread_exec_create(0, 1) == NULL);
+	TEST_ASSERT(uthread_exec_submit(NULL, quitter, NULL) == -1);
+}
+
+int main(void)
+{
+	uthread_start(0);
+
+	test_bounded();
+	test_reject();
+	test_exit();
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Futures test
+ *
+ * Fans a request out to several backends with uthread_async() and gathers
+ * the results with uthread_when_any(), uthread_when_all() and
+ * uthread_future_get(). Backends yield a different number of times, so the
+ * program should output:
+ *
+ * first: backend 1
+ * all: 10 20 30
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define BACKENDS 3
+
+/* Number of yields each backend needs before answering */
+static int delays[BACKENDS] = {5, 1, 3};
+
+void *backend(void *arg)
+{
+	int id = (int)(long)arg;
+
+	for (int i = 0; i < delays[id]; i++)
+		uthread_yield();
+
+	return (void*)(long)((id + 1) * 10);
+}
+
+void *waiter(void *arg)
+{
+	void *result;
+
+	/* several threads can wait for the same future */
+	uthread_future_get(arg, &result);
+	return result;
+}
+
+int main(void)
+{
+	uthread_future_t futures[BACKENDS], shared;
+	void *result;
+	int i, first;
+
+	uthread_start(0);
+
+	for (i = 0; i < BACKENDS; i++)
+		futures[i] = uthread_async(backend, (void*)(long)i);
+
+	first = uthread_when_any(futures, BACKENDS);
+	printf("first: backend %d\n", first);
+	if (first != 1)
+		exit(1);
+
+	shared = uthread_async(waiter, futures[0]);
+	uthread_when_all(futures, BACKENDS);
+
+	printf("all:");
+	for (i = 0; i < BACKENDS; i++) {
+		uthread_future_get(futures[i], &result);
+		printf(" %d", (int)(long)result);
+		if ((long)result != (i + 1) * 10)
+			exit(1);
+	}
+	printf("\n");
+
+	uthread_future_get(shared, &result);
+	if ((long)result != 10)
+		exit(1);
+
+	for (i = 0; i < BACKENDS; i++)
+		uthread_future_destroy(futures[i]);
+	uthread_future_destroy(shared);
+
+	uthread_stop();
+	return 0;
+}
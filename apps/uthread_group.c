@@ -0,0 +1,99 @@
+/*
+ * Scheduling group test
+ *
+ * A group with many threads and a group with a few threads compete for the
+ * CPU: with equal weights they must get about the same CPU time, and with
+ * weights 1 and 3 the second group must get about three times as much.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define CROWD 100
+#define FEW 2
+/* Duration of each run, in milliseconds */
+#define RUN_MS 200
+
+static double end_ms;
+
+static double clock_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* burn the CPU in short slices until the end of the run */
+int spinner(void)
+{
+	while (clock_ms() < end_ms) {
+		double slice = clock_ms() + 0.05;
+
+		while (clock_ms() < slice)
+			;
+		uthread_yield();
+	}
+	return 0;
+}
+
+/* run a crowded group against a small one, return their CPU time ratio */
+static double run(unsigned int crowd_weight, unsigned int few_weight)
+{
+	uthread_group_t crowd = uthread_group_create(crowd_weight);
+	uthread_group_t few = uthread_group_create(few_weight);
+	uthread_t tids[CROWD + FEW];
+	int i;
+
+	end_ms = clock_ms() + RUN_MS;
+	for (i = 0; i < CROWD; i++)
+		tids[i] = uthread_create_group(crowd, spinner);
+	for (i = 0; i < FEW; i++)
+		tids[CROWD + i] = uthread_create_group(few, spinner);
+	uthread_join_all(tids, CROWD + FEW, NULL);
+
+	double crowd_ms = uthread_group_cpu_time(crowd) / 1e6;
+	double few_ms = uthread_group_cpu_time(few) / 1e6;
+
+	printf("weights %u/%u: %d threads %.1f ms, %d threads %.1f ms\n",
+	       crowd_weight, few_weight, CROWD, crowd_ms, FEW, few_ms);
+
+	if (uthread_group_destroy(crowd) != 0 || uthread_group_destroy(few) != 0)
+		exit(1);
+
+	return few_ms / crowd_ms;
+}
+
+int main(void)
+{
+	double ratio;
+
+	uthread_start(0);
+
+	TEST_ASSERT(uthread_group_create(0) == NULL);
+	TEST_ASSERT(uthread_group_destroy(uthread_group_self()) == -1);
+
+	ratio = run(1024, 1024);
+	TEST_ASSERT(ratio > 0.8 && ratio < 1.25);
+
+	ratio = run(1024, 3072);
+	TEST_ASSERT(ratio > 2.4 && ratio < 3.75);
+
+	uthread_stop();
+	return 0;
+}
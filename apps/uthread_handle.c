@@ -0,0 +1,90 @@
+/*
+ * Thread handle test
+ *
+ * More than USHRT_MAX threads are created and joined one after the other, so
+ * that TIDs wrap around and are reused. The handle of a reclaimed thread must
+ * be rejected, even once its TID belongs to another thread.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+/* Number of threads created and joined, beyond the TID range */
+#define THREADS USHRT_MAX
+
+static uthread_handle_t self;
+
+int quick(void)
+{
+	return 1;
+}
+
+int reporter(void)
+{
+	self = uthread_self_handle();
+	return 2;
+}
+
+int main(void)
+{
+	uthread_handle_t stale, handle;
+	int tid, stale_tid, retval, total = 0;
+
+	uthread_start(0);
+
+	TEST_ASSERT(uthread_handle_tid(uthread_self_handle()) == 0);
+	TEST_ASSERT(uthread_cancel_handle(uthread_self_handle()) == -1);
+
+	stale = uthread_create_handle(reporter);
+	stale_tid = uthread_handle_tid(stale);
+	TEST_ASSERT(stale != UTHREAD_HANDLE_INVALID && stale_tid > 0);
+	TEST_ASSERT(uthread_handle(stale_tid) == stale);
+	TEST_ASSERT(uthread_join_handle(stale, &retval) == 0 && retval == 2);
+	TEST_ASSERT(self == stale);
+
+	/* a reclaimed thread has no handle anymore */
+	TEST_ASSERT(uthread_handle_tid(stale) == -1);
+	TEST_ASSERT(uthread_join_handle(stale, NULL) == -1);
+	TEST_ASSERT(uthread_cancel_handle(stale) == -1);
+
+	/* TIDs wrap around instead of running out */
+	for (int i = 0; i < THREADS; i++) {
+		tid = uthread_create(quick);
+		if (tid == -1)
+			break;
+		uthread_join(tid, &retval);
+		total += retval;
+	}
+	TEST_ASSERT(tid != -1 && total == THREADS);
+
+	/* the stale handle does not reach the thread which has its TID now */
+	do {
+		handle = uthread_create_handle(quick);
+		tid = uthread_handle_tid(handle);
+		if (tid != stale_tid)
+			uthread_join_handle(handle, NULL);
+	} while (tid != stale_tid && tid != -1);
+	TEST_ASSERT(tid == stale_tid && handle != stale);
+	TEST_ASSERT(uthread_handle(stale_tid) == handle);
+	TEST_ASSERT(uthread_handle_tid(stale) == -1);
+	TEST_ASSERT(uthread_cancel_handle(stale) == -1);
+	TEST_ASSERT(uthread_join_handle(stale, NULL) == -1);
+	TEST_ASSERT(uthread_join_handle(handle, &retval) == 0 && retval == 1);
+
+	uthread_stop();
+	return 0;
+}
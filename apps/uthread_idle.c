@@ -0,0 +1,210 @@
+/*
+ * Idle scheduler test
+ *
+ * Threads sleep, wait for a pipe and get joined while nothing else can run.
+ * The process must sleep in the kernel during those waits instead of spinning
+ * through the ready queue: the CPU time used while waiting stays far below the
+ * elapsed time, and sleepers wake up in deadline order.
+ *
+ * Then a pipe is written while threads keep the CPU busy under preemption: the
+ * reader must still be woken up within a few time slices.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+/* Number of sleeps measured for the wakeup latency */
+#define LATENCY_SLEEPS 100
+
+static int pipe_fds[2];
+static int order[3], order_count;
+static volatile int busy_done;
+static double written, woken;
+
+static double clock_us(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* sleeps for a number of milliseconds given by its TID */
+int sleeper(void)
+{
+	int ms = 10 * (4 - uthread_self());
+
+	uthread_sleep(ms * 1000);
+	order[order_count++] = uthread_self();
+	return 0;
+}
+
+int reader(void)
+{
+	char c;
+
+	if (!(uthread_wait_fd(pipe_fds[0], POLLIN) & POLLIN))
+		return 1;
+	if (read(pipe_fds[0], &c, 1) != 1)
+		return 1;
+	return c;
+}
+
+int writer(void)
+{
+	uthread_sleep(10000);
+	if (write(pipe_fds[1], "x", 1) != 1)
+		return 1;
+	return 0;
+}
+
+int busy(void)
+{
+	while (!busy_done)
+		;
+	return 0;
+}
+
+int busy_reader(void)
+{
+	int c = reader();
+
+	woken = clock_us(CLOCK_MONOTONIC);
+	busy_done = 1;
+	return c;
+}
+
+int busy_writer(void)
+{
+	written = clock_us(CLOCK_MONOTONIC);
+	if (write(pipe_fds[1], "y", 1) != 1)
+		return 1;
+	return 0;
+}
+
+void test_sleep_order(void)
+{
+	int tids[3], i;
+
+	fprintf(stderr, "*** TEST sleep order ***\n");
+
+	for (i = 0; i < 3; i++)
+		tids[i] = uthread_create(sleeper);
+
+	double wall = clock_us(CLOCK_MONOTONIC);
+	double cpu = clock_us(CLOCK_PROCESS_CPUTIME_ID);
+	for (i = 0; i < 3; i++)
+		uthread_join(tids[i], NULL);
+	wall = clock_us(CLOCK_MONOTONIC) - wall;
+	cpu = clock_us(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+	TEST_ASSERT(order[0] == tids[2] && order[1] == tids[1] &&
+		    order[2] == tids[0]);
+	TEST_ASSERT(wall >= 30000);
+	/* the process slept instead of spinning */
+	TEST_ASSERT(cpu < wall / 10);
+}
+
+void test_fd(void)
+{
+	int tid_reader, retval;
+
+	fprintf(stderr, "*** TEST wait fd ***\n");
+
+	if (pipe(pipe_fds) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+
+	tid_reader = uthread_create(reader);
+	uthread_create(writer);
+
+	double cpu = clock_us(CLOCK_PROCESS_CPUTIME_ID);
+	uthread_join(tid_reader, &retval);
+	cpu = clock_us(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+	TEST_ASSERT(retval == 'x');
+	TEST_ASSERT(cpu < 5000);
+	TEST_ASSERT(uthread_wait_fd(-1, POLLIN) == -1);
+
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+}
+
+void test_latency(void)
+{
+	double late = 0;
+
+	fprintf(stderr, "*** TEST wakeup latency ***\n");
+
+	for (int i = 0; i < LATENCY_SLEEPS; i++) {
+		double start = clock_us(CLOCK_MONOTONIC);
+		uthread_sleep(1000);
+		late += clock_us(CLOCK_MONOTONIC) - start - 1000;
+	}
+
+	printf("average wakeup latency: %.1f us\n", late / LATENCY_SLEEPS);
+	TEST_ASSERT(late >= 0);
+}
+
+void test_busy_fd(void)
+{
+	int tids[2], tid_reader, retval;
+
+	fprintf(stderr, "*** TEST wait fd while busy ***\n");
+
+	if (pipe(pipe_fds) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+
+	tid_reader = uthread_create(busy_reader);
+	tids[0] = uthread_create(busy);
+	tids[1] = uthread_create(busy);
+	uthread_create(busy_writer);
+
+	uthread_join(tid_reader, &retval);
+	uthread_join(tids[0], NULL);
+	uthread_join(tids[1], NULL);
+
+	/* ready threads delay the poll by one time slice at most */
+	printf("fd wakeup latency while busy: %.0f us\n", woken - written);
+	TEST_ASSERT(retval == 'y');
+	TEST_ASSERT(woken - written < 100000);
+
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+}
+
+int main(void)
+{
+	uthread_start(0);
+
+	test_sleep_order();
+	test_fd();
+	test_latency();
+
+	uthread_stop();
+
+	uthread_start(1);
+	test_busy_fd();
+	uthread_stop();
+
+	return 0;
+}
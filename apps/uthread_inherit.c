@@ -0,0 +1,136 @@
+/*
+ * Deadline inheritance test
+ *
+ * A best-effort thread holds a mutex across many yields while best-effort
+ * threads spin around it. A thread with a deadline waiting for the mutex must
+ * get it before the spinning threads run again, and the owner must give the
+ * deadline back when it unlocks. The deadline must also be lent along a chain
+ * of owners, each waiting for the mutex of the next one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define SPINNERS 4
+#define HOLD 100
+
+static uthread_mutex_t first = UTHREAD_MUTEX_INITIALIZER;
+static uthread_mutex_t second = UTHREAD_MUTEX_INITIALIZER;
+static int spins, stop;
+static int spins_seen, given_back;
+
+int spinner(void)
+{
+	while (!stop) {
+		spins++;
+		uthread_yield();
+	}
+	return 0;
+}
+
+/* best-effort owner of the first mutex */
+int low(void)
+{
+	int before;
+
+	uthread_mutex_lock(&first);
+	for (int i = 0; i < HOLD; i++)
+		uthread_yield();
+	uthread_mutex_unlock(&first);
+
+	/* best effort again, behind the spinners */
+	before = spins;
+	uthread_yield();
+	given_back = spins > before;
+	return 0;
+}
+
+/* best-effort owner of the second mutex, waiting for the first one */
+int chained(void)
+{
+	uthread_mutex_lock(&second);
+	uthread_mutex_lock(&first);
+	uthread_mutex_unlock(&first);
+	uthread_mutex_unlock(&second);
+	return 0;
+}
+
+static int high(uthread_mutex_t *mutex)
+{
+	uthread_set_deadline(1000000);
+	uthread_mutex_lock(mutex);
+	spins_seen = spins;
+	uthread_mutex_unlock(mutex);
+	uthread_set_deadline(0);
+	return 0;
+}
+
+int high_first(void)
+{
+	return high(&first);
+}
+
+int high_second(void)
+{
+	return high(&second);
+}
+
+int main(void)
+{
+	uthread_t tids[SPINNERS + 3];
+	struct uthread_stats stats;
+	int i, start;
+
+	uthread_start(0);
+
+	/* the owner is lent the deadline of the waiter */
+	tids[0] = uthread_create(low);
+	uthread_yield();
+	for (i = 1; i <= SPINNERS; i++)
+		tids[i] = uthread_create(spinner);
+	start = spins;
+	tids[i] = uthread_create(high_first);
+	uthread_join(tids[i], NULL);
+	uthread_join(tids[0], NULL);
+	printf("spins while waiting: %d\n", spins_seen - start);
+	TEST_ASSERT(spins_seen - start < HOLD);
+	TEST_ASSERT(given_back);
+	uthread_get_stats(&stats);
+	TEST_ASSERT(stats.mutex_boosts == 1);
+
+	/* and so is the owner of the mutex its own owner waits for */
+	tids[0] = uthread_create(low);
+	uthread_yield();
+	tids[SPINNERS + 1] = uthread_create(chained);
+	uthread_yield();
+	start = spins;
+	tids[SPINNERS + 2] = uthread_create(high_second);
+	uthread_join(tids[SPINNERS + 2], NULL);
+	uthread_join(tids[SPINNERS + 1], NULL);
+	uthread_join(tids[0], NULL);
+	printf("spins while waiting: %d\n", spins_seen - start);
+	TEST_ASSERT(spins_seen - start < HOLD);
+	uthread_get_stats(&stats);
+	TEST_ASSERT(stats.mutex_boosts == 3);
+
+	stop = 1;
+	uthread_join_all(&tids[1], SPINNERS, NULL);
+	TEST_ASSERT(uthread_mutex_trylock(&first) == 0);
+	uthread_mutex_unlock(&first);
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Wait-set test
+ *
+ * A thread joins a set of threads at once with uthread_join_all(), or the
+ * first of them to complete with uthread_join_any(). Finally 60000 threads are
+ * left for uthread_stop(), which must collect them in milliseconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define SET 8
+#define MANY 60000
+
+static double clock_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int started;
+
+/* threads sleep in reverse order of creation, the last one exits first */
+int worker(void)
+{
+	int order = started++ % SET;
+
+	uthread_sleep((SET - order) * 2000);
+	return uthread_self();
+}
+
+int quick(void)
+{
+	return 0;
+}
+
+int main(void)
+{
+	uthread_t tids[SET];
+	int retvals[SET];
+	int i, which, retval, ok = 1;
+	double start;
+
+	uthread_start(0);
+
+	for (i = 0; i < SET; i++)
+		tids[i] = uthread_create(worker);
+	TEST_ASSERT(uthread_join_all(tids, SET, retvals) == 0);
+	for (i = 0; i < SET; i++)
+		ok = ok && retvals[i] == tids[i];
+	TEST_ASSERT(ok);
+
+	/* the last created thread exits first, the others remain joinable */
+	for (i = 0; i < SET; i++)
+		tids[i] = uthread_create(worker);
+	TEST_ASSERT(uthread_join_any(tids, SET, &which, &retval) == 0);
+	TEST_ASSERT(which == SET - 1 && retval == tids[SET - 1]);
+	TEST_ASSERT(uthread_join_all(tids, SET - 1, NULL) == 0);
+
+	/* invalid sets join nothing */
+	tids[0] = uthread_create(quick);
+	tids[1] = tids[0];
+	TEST_ASSERT(uthread_join_all(tids, 2, NULL) == -1);
+	TEST_ASSERT(uthread_join_any(tids, 0, NULL, NULL) == -1);
+	tids[1] = 0;
+	TEST_ASSERT(uthread_join_any(tids, 2, NULL, NULL) == -1);
+	TEST_ASSERT(uthread_join_any(tids, 1, &which, &retval) == 0);
+	TEST_ASSERT(which == 0 && retval == 0);
+
+	for (i = 0; i < MANY; i++) {
+		if (uthread_create(quick) == -1)
+			exit(1);
+	}
+	start = clock_ms();
+	uthread_stop();
+	printf("stop with %d threads: %.1f ms\n", MANY, clock_ms() - start);
+
+	return 0;
+}
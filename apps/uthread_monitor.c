@@ -0,0 +1,159 @@
+/*
+ * Shared memory monitor test
+ *
+ * With preemption, a thread burns the CPU without yielding while others are
+ * parked, and the main thread sleeps. The segment, mapped read-only like
+ * uthread_top does, must show every thread in its state, the CPU time and the
+ * preemptions of the busy thread, and keep being updated. It must disappear
+ * once the monitor stops.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <monitor.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define PARKED 3
+
+static int gate;
+static volatile int stop;
+
+static double clock_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int parked(void)
+{
+	while (gate == 0)
+		uthread_park(&gate, 0);
+	return 0;
+}
+
+/* never yields, only the timer takes the CPU from it */
+int busy(void)
+{
+	double end = clock_ms() + 2000;
+
+	while (!stop && clock_ms() < end)
+		;
+	return 0;
+}
+
+static void snapshot(const struct uthread_monitor *segment,
+		     struct uthread_monitor *copy, size_t size)
+{
+	uint32_t seq;
+
+	do {
+		while ((seq = __atomic_load_n(&segment->seq, __ATOMIC_ACQUIRE)) % 2)
+			;
+		memcpy(copy, segment, size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&segment->seq, __ATOMIC_RELAXED) != seq);
+}
+
+static const struct uthread_monitor_thread *
+find(const struct uthread_monitor *copy, uthread_handle_t handle)
+{
+	for (unsigned int i = 0; i < copy->published; i++) {
+		if (copy->thread[i].handle == handle)
+			return &copy->thread[i];
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	struct uthread_monitor *segment, *copy;
+	const struct uthread_monitor_thread *t;
+	uthread_handle_t waiters[PARKED], hog;
+	uthread_t tids[PARKED + 1];
+	struct stat st;
+	char name[32];
+	uint64_t updates;
+	int i, fd;
+
+	uthread_start(1);
+
+	TEST_ASSERT(uthread_monitor_start(0) == -1);
+	TEST_ASSERT(uthread_monitor_start(10) == 0);
+	TEST_ASSERT(uthread_monitor_start(10) == -1);
+
+	for (i = 0; i < PARKED; i++) {
+		tids[i] = uthread_create(parked);
+		waiters[i] = uthread_handle(tids[i]);
+	}
+	tids[i] = uthread_create(busy);
+	hog = uthread_handle(tids[i]);
+
+	/* a few updates while the busy thread runs */
+	uthread_sleep(100000);
+
+	snprintf(name, sizeof(name), UTHREAD_MONITOR_NAME, getpid());
+	fd = shm_open(name, O_RDONLY, 0);
+	TEST_ASSERT(fd != -1);
+	fstat(fd, &st);
+	segment = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	TEST_ASSERT(segment != MAP_FAILED);
+	copy = malloc(st.st_size);
+
+	snapshot(segment, copy, st.st_size);
+	TEST_ASSERT(copy->magic == UTHREAD_MONITOR_MAGIC);
+	TEST_ASSERT(copy->period_ms == 10);
+	TEST_ASSERT(copy->threads == PARKED + 2);
+	TEST_ASSERT(copy->published == PARKED + 2);
+	for (i = 0; i < PARKED; i++) {
+		t = find(copy, waiters[i]);
+		TEST_ASSERT(t != NULL && t->state == UTHREAD_MONITOR_BLOCKED);
+	}
+	t = find(copy, hog);
+	TEST_ASSERT(t != NULL);
+	printf("busy thread: %.1f ms, %llu preemptions\n", t->run_time / 1e6,
+	       (unsigned long long)t->preemptions);
+	TEST_ASSERT(t->run_time > 10000000);
+	TEST_ASSERT(t->preemptions > 0);
+	TEST_ASSERT(copy->preemptions >= t->preemptions);
+	updates = copy->updates;
+
+	uthread_sleep(50000);
+	snapshot(segment, copy, st.st_size);
+	TEST_ASSERT(copy->updates > updates);
+
+	stop = 1;
+	gate = 1;
+	uthread_unpark(&gate, INT_MAX);
+	uthread_join_all(tids, PARKED + 1, NULL);
+
+	TEST_ASSERT(uthread_monitor_stop() == 0);
+	TEST_ASSERT(uthread_monitor_stop() == -1);
+	TEST_ASSERT(shm_open(name, O_RDONLY, 0) == -1);
+
+	free(copy);
+	munmap(segment, st.st_size);
+	uthread_stop();
+	return 0;
+}
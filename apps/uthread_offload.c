@@ -0,0 +1,202 @@
+/*
+ * Offload pool test
+ *
+ * Threads offload slow blocking calls to the helper kernel threads while a
+ * ticker thread keeps sleeping for 1 ms at a time. The ticker must keep its
+ * pace during the slow calls, and every offloaded call must return its own
+ * result, including when more calls are made than the pool can hold.
+ *
+ * Then many more threads than the pool can hold offload short calls to a pool
+ * whose depth is not a power of two, while the main thread keeps the CPU
+ * without collecting the completed calls. No completion may be lost.
+ *
+ * Last, a cancelled thread offloads a call from its cleanup handler while the
+ * pool is full, and must still get its result.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define CALLERS 8
+#define FLOODERS 200
+
+static volatile int done;
+static double ticker_max_gap;
+static int results_ok;
+static int flood_ok;
+static int cleanup_ok;
+
+static double clock_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* a call blocking its kernel thread for 20 ms */
+void *slow_double(void *arg)
+{
+	struct timespec ts = {0, 20 * 1000 * 1000};
+
+	nanosleep(&ts, NULL);
+	return (void*)((long)arg * 2);
+}
+
+void *do_stat(void *arg)
+{
+	struct stat st;
+
+	return (void*)(long)stat(arg, &st);
+}
+
+int ticker(void)
+{
+	double last = clock_us();
+
+	while (!done) {
+		uthread_sleep(1000);
+		double now = clock_us();
+		if (now - last > ticker_max_gap)
+			ticker_max_gap = now - last;
+		last = now;
+	}
+	return 0;
+}
+
+/* a call blocking its kernel thread for 1 ms */
+void *short_double(void *arg)
+{
+	struct timespec ts = {0, 1000 * 1000};
+
+	nanosleep(&ts, NULL);
+	return (void*)((long)arg * 2);
+}
+
+int flooder(void)
+{
+	void *result;
+	long id = uthread_self();
+
+	uthread_offload(short_double, (void*)id, &result);
+	if ((long)result == id * 2)
+		flood_ok++;
+	return 0;
+}
+
+/* offload from a cleanup handler, while the thread is being cancelled */
+void offload_cleanup(void *arg)
+{
+	void *result;
+
+	if (uthread_offload(short_double, arg, &result) == 0 &&
+	    (long)result == (long)arg * 2)
+		cleanup_ok = 1;
+}
+
+int victim(void)
+{
+	uthread_cleanup_push(offload_cleanup, (void*)21L);
+	uthread_sleep(1000000);
+	return 0;
+}
+
+int caller(void)
+{
+	void *result;
+	long id = uthread_self();
+
+	uthread_offload(slow_double, (void*)id, &result);
+	if ((long)result == id * 2)
+		results_ok++;
+	return 0;
+}
+
+int main(void)
+{
+	int tids[CALLERS], ticker_tid, victim_tid, i;
+	uthread_t flood[FLOODERS];
+	double end;
+	void *result;
+
+	/* fewer helpers and room than callers */
+	TEST_ASSERT(uthread_offload_config(2, 2) == 0);
+	uthread_start(0);
+
+	ticker_tid = uthread_create(ticker);
+	for (i = 0; i < CALLERS; i++)
+		tids[i] = uthread_create(caller);
+	for (i = 0; i < CALLERS; i++)
+		uthread_join(tids[i], NULL);
+
+	TEST_ASSERT(results_ok == CALLERS);
+	TEST_ASSERT(uthread_offload(do_stat, "/", &result) == 0);
+	TEST_ASSERT(result == 0);
+	TEST_ASSERT(uthread_offload_config(4, 4) == -1);
+
+	done = 1;
+	uthread_join(ticker_tid, NULL);
+
+	/* the slow calls did not stall the ticker */
+	printf("ticker max gap: %.0f us\n", ticker_max_gap);
+	TEST_ASSERT(ticker_max_gap < 10000);
+
+	uthread_stop();
+
+	TEST_ASSERT(uthread_offload_config(4, 100) == 0);
+	uthread_start(0);
+
+	/*
+	 * new callers keep filling the room the helpers make in the submit
+	 * queue, then the calls complete without being collected
+	 */
+	for (i = 0; i < FLOODERS; i++) {
+		flood[i] = uthread_create(flooder);
+		if (i % 10 == 9) {
+			uthread_yield();
+			end = clock_us() + 1000;
+			while (clock_us() < end)
+				;
+		}
+	}
+	end = clock_us() + 300000;
+	while (clock_us() < end)
+		;
+
+	TEST_ASSERT(uthread_join_all(flood, FLOODERS, NULL) == 0);
+	TEST_ASSERT(flood_ok == FLOODERS);
+
+	uthread_stop();
+
+	TEST_ASSERT(uthread_offload_config(2, 2) == 0);
+	uthread_start(0);
+
+	/* the slow calls fill the pool before the victim is cancelled */
+	tids[0] = uthread_create(caller);
+	tids[1] = uthread_create(caller);
+	victim_tid = uthread_create(victim);
+	uthread_yield();
+	TEST_ASSERT(uthread_cancel(victim_tid) == 0);
+	uthread_join(victim_tid, NULL);
+	uthread_join(tids[0], NULL);
+	uthread_join(tids[1], NULL);
+	TEST_ASSERT(cleanup_ok);
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Ping-pong benchmark
+ *
+ * Two threads exchange messages while other threads keep yielding. With
+ * uthread_yield(), every message waits for a full rotation of the ready queue
+ * before its receiver runs; with uthread_yield_to(), the sender hands the CPU
+ * straight to the receiver. Prints the average cost of a round trip for both.
+ *
+ * Threads skipped over by uthread_yield_to() must keep their place in the
+ * ready queue.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define ROUNDS 20000
+#define BUSY 100
+
+/* whose turn it is to send, 0 for ping and 1 for pong */
+static volatile int turn;
+static volatile int done;
+static int direct;
+static uthread_t ping_tid, pong_tid;
+static uthread_t order[3];
+static int order_count;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* let the peer thread run, directly if possible */
+static void handoff(uthread_t peer)
+{
+	if (!direct || uthread_yield_to(peer) == -1)
+		uthread_yield();
+}
+
+int ping(void)
+{
+	for (int i = 0; i < ROUNDS; i++) {
+		while (turn != 0)
+			handoff(pong_tid);
+		turn = 1;
+		handoff(pong_tid);
+	}
+	done = 1;
+	return 0;
+}
+
+int pong(void)
+{
+	while (!done) {
+		if (turn == 1)
+			turn = 0;
+		handoff(ping_tid);
+	}
+	return 0;
+}
+
+int busy(void)
+{
+	while (!done)
+		uthread_yield();
+	return 0;
+}
+
+int record(void)
+{
+	order[order_count++] = uthread_self();
+	return 0;
+}
+
+static void run(int mode, const char *name)
+{
+	int busy_tids[BUSY];
+	double start;
+	int i;
+
+	direct = mode;
+	turn = 0;
+	done = 0;
+
+	for (i = 0; i < BUSY; i++)
+		busy_tids[i] = uthread_create(busy);
+	ping_tid = uthread_create(ping);
+	pong_tid = uthread_create(pong);
+
+	start = now();
+	uthread_join(ping_tid, NULL);
+	printf("%-9s %10.1f ns/round trip\n", name, (now() - start) / ROUNDS);
+
+	uthread_join(pong_tid, NULL);
+	for (i = 0; i < BUSY; i++)
+		uthread_join(busy_tids[i], NULL);
+}
+
+int main(void)
+{
+	uthread_start(0);
+
+	/* nothing to hand the CPU to */
+	if (uthread_yield_to(uthread_self()) != -1 ||
+	    uthread_yield_to(1000) != -1) {
+		fprintf(stderr, "uthread_yield_to should fail\n");
+		exit(1);
+	}
+
+	/* the target leaves the middle of the queue, the others keep their order */
+	uthread_t a = uthread_create(record);
+	uthread_t b = uthread_create(record);
+	uthread_t c = uthread_create(record);
+	if (uthread_yield_to(b) != 0 || order_count != 3 || order[0] != b ||
+	    order[1] != a || order[2] != c) {
+		fprintf(stderr, "uthread_yield_to broke the ready queue order\n");
+		exit(1);
+	}
+	uthread_join(a, NULL);
+	uthread_join(b, NULL);
+	uthread_join(c, NULL);
+
+	run(0, "yield");
+	run(1, "yield_to");
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Sampling profiler test
+ *
+ * Two threads burn the CPU in different functions while the profiler samples
+ * at 1 kHz. The folded stacks must attribute samples to each thread and its
+ * function. The CPU time of an offload helper must not be sampled, and taking
+ * the samples must cost less than 1% of the CPU time at 1 kHz.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+/* Samples taken by hand to measure their cost, fewer than the buffer holds */
+#define SAMPLES 4000
+/* Runs of the cost measurement */
+#define RUNS 5
+
+static char profile_path[] = "/tmp/uthread_profile.XXXXXX";
+
+static volatile long sink;
+
+static double clock_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+__attribute__((noinline)) void burn_alpha(double ms)
+{
+	double end = clock_ms() + ms;
+
+	while (clock_ms() < end)
+		sink++;
+}
+
+__attribute__((noinline)) void burn_beta(double ms)
+{
+	double end = clock_ms() + ms;
+
+	while (clock_ms() < end)
+		sink--;
+}
+
+int alpha(void)
+{
+	for (int i = 0; i < 20; i++) {
+		burn_alpha(5);
+		uthread_yield();
+	}
+	return 0;
+}
+
+int beta(void)
+{
+	for (int i = 0; i < 20; i++) {
+		burn_beta(5);
+		uthread_yield();
+	}
+	return 0;
+}
+
+/* CPU time of the kernel thread, which other processes do not inflate */
+static double cpu_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* a CPU-bound call run by an offload helper */
+static void *burn_helper(void *arg)
+{
+	double end = clock_ms() + (long)arg;
+
+	while (clock_ms() < end)
+		;
+	return NULL;
+}
+
+/*
+ * CPU time of one sample, signal delivery included: the timer is replaced by
+ * SIGPROF sent by hand, which a loop timed with and without the profiler could
+ * not tell apart from noise at 1 kHz
+ */
+static double sample_us(void)
+{
+	double start = cpu_ms();
+
+	for (int i = 0; i < SAMPLES; i++)
+		pthread_kill(pthread_self(), SIGPROF);
+	return (cpu_ms() - start) * 1e3 / SAMPLES;
+}
+
+/* whether a line of the profile contains both strings */
+static int profile_has(const char *thread, const char *func)
+{
+	char line[4096];
+	int found = 0;
+	FILE *in = fopen(profile_path, "r");
+
+	if (in == NULL)
+		return 0;
+	while (!found && fgets(line, sizeof(line), in) != NULL)
+		found = strncmp(line, thread, strlen(thread)) == 0 &&
+			strstr(line, func) != NULL;
+	fclose(in);
+
+	return found;
+}
+
+/* total number of samples of the profile */
+static long profile_samples(void)
+{
+	char line[4096];
+	long total = 0;
+	FILE *in = fopen(profile_path, "r");
+
+	if (in == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), in) != NULL) {
+		char *count = strrchr(line, ' ');
+
+		if (count != NULL)
+			total += atol(count + 1);
+	}
+	fclose(in);
+
+	return total;
+}
+
+int main(void)
+{
+	uthread_t tids[2];
+	char name[32];
+	double cost = 1e9, us;
+	long samples;
+	int fd;
+
+	fd = mkstemp(profile_path);
+	TEST_ASSERT(fd != -1);
+	close(fd);
+
+	uthread_start(0);
+
+	TEST_ASSERT(uthread_profile_start(0) == -1);
+	TEST_ASSERT(uthread_profile_start(1000) == 0);
+	TEST_ASSERT(uthread_profile_start(1000) == -1);
+
+	tids[0] = uthread_create(alpha);
+	tids[1] = uthread_create(beta);
+	uthread_join_all(tids, 2, NULL);
+
+	uthread_profile_stop();
+	TEST_ASSERT(uthread_profile_dump(profile_path) == 0);
+
+	snprintf(name, sizeof(name), "uthread-%d;", tids[0]);
+	TEST_ASSERT(profile_has(name, "alpha;burn_alpha"));
+	snprintf(name, sizeof(name), "uthread-%d;", tids[1]);
+	TEST_ASSERT(profile_has(name, "beta;burn_beta"));
+
+	/* 200 ms of CPU in a helper while the scheduler thread sleeps */
+	uthread_profile_start(1000);
+	uthread_offload(burn_helper, (void*)200L, NULL);
+	uthread_profile_stop();
+	TEST_ASSERT(uthread_profile_dump(profile_path) == 0);
+	samples = profile_samples();
+	printf("samples while a helper burns the CPU: %ld\n", samples);
+	TEST_ASSERT(samples >= 0 && samples < 20);
+
+	/* the overhead at 1 kHz, best of a few runs */
+	for (int i = 0; i < RUNS; i++) {
+		TEST_ASSERT(uthread_profile_start(1) == 0);
+		us = sample_us();
+		uthread_profile_stop();
+		uthread_profile_dump(profile_path);
+		if (us < cost)
+			cost = us;
+	}
+	printf("sample: %.2f us, %.3f%% of the CPU at 1 kHz\n", cost,
+	       cost * 1000 / 1e6 * 100);
+	TEST_ASSERT(cost * 1000 < 1e6 * 0.01);
+
+	unlink(profile_path);
+	uthread_stop();
+	return 0;
+}
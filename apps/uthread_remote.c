@@ -0,0 +1,125 @@
+/*
+ * Remote submission test
+ *
+ * Kernel threads created with pthread_create() hand work to the threading
+ * library with uthread_submit_remote() while the main thread waits for them
+ * in uthread_wait_remote(), so that the scheduler has to sleep until the
+ * first request arrives. They also wake threads up with uthread_wake_remote().
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define PRODUCERS 4
+#define JOBS 20000
+
+static uthread_handle_t main_handle;
+static long jobs_done, jobs_sum;
+static int woken;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* runs in a thread of the library */
+static void *job(void *arg)
+{
+	jobs_sum += (long)arg;
+	if (++jobs_done == PRODUCERS * JOBS)
+		uthread_wake_remote(main_handle);
+	return NULL;
+}
+
+/* runs in a kernel thread of its own */
+static void *producer(void *arg)
+{
+	/* let the scheduler fall asleep first */
+	usleep(10000);
+
+	for (long i = 0; i < JOBS; i++) {
+		if (uthread_submit_remote(job, (void*)((long)arg + i)) == -1)
+			exit(1);
+	}
+	return NULL;
+}
+
+static void *waker(void *arg)
+{
+	usleep(10000);
+	uthread_wake_remote(*(uthread_handle_t*)arg);
+	return NULL;
+}
+
+int waiter(void)
+{
+	uthread_wait_remote();
+	woken++;
+	return 0;
+}
+
+int main(void)
+{
+	pthread_t threads[PRODUCERS];
+	uthread_handle_t handle;
+	long expected = 0;
+	double start;
+
+	uthread_start(0);
+	main_handle = uthread_self_handle();
+
+	/* the jobs of every producer run, in threads of the library */
+	start = now();
+	for (long i = 0; i < PRODUCERS; i++) {
+		pthread_create(&threads[i], NULL, producer, (void*)(i * JOBS));
+		expected += JOBS * (JOBS - 1) / 2 + i * JOBS * JOBS;
+	}
+	while (jobs_done < PRODUCERS * JOBS)
+		uthread_wait_remote();
+	printf("%.1f ns/job\n", (now() - start) / (PRODUCERS * JOBS));
+	for (int i = 0; i < PRODUCERS; i++)
+		pthread_join(threads[i], NULL);
+	TEST_ASSERT(jobs_done == PRODUCERS * JOBS && jobs_sum == expected);
+
+	/* a thread is woken up by another kernel thread */
+	handle = uthread_create_handle(waiter);
+	pthread_create(&threads[0], NULL, waker, &handle);
+	TEST_ASSERT(uthread_join_handle(handle, NULL) == 0 && woken == 1);
+	pthread_join(threads[0], NULL);
+
+	/* a wakeup which came first is kept for the next wait */
+	woken = 0;
+	uthread_wake_remote(main_handle);
+	uthread_yield();
+	uthread_wait_remote();
+	woken++;
+	TEST_ASSERT(woken == 1);
+
+	/* the wakeup of a thread which exited is ignored */
+	TEST_ASSERT(uthread_wake_remote(handle) == 0);
+	TEST_ASSERT(uthread_wake_remote(UTHREAD_HANDLE_INVALID) == -1);
+	TEST_ASSERT(uthread_submit_remote(NULL, NULL) == -1);
+	uthread_yield();
+
+	uthread_stop();
+	return 0;
+}
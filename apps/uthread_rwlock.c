@@ -0,0 +1,154 @@
+/*
+ * Reader-writer lock, barrier and once test
+ *
+ * Readers hold the lock together while yielding, a writer waiting for the lock
+ * holds new readers back, and the readers parked behind it all enter once it
+ * unlocks. A thousand threads go through a barrier for several phases, without
+ * any of them running ahead. Finally an initialization function runs once
+ * while other threads wait for it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define READERS 8
+#define BARRIER_THREADS 1000
+#define PHASES 5
+
+static uthread_rwlock_t rwlock = UTHREAD_RWLOCK_INITIALIZER;
+static int inside, max_inside;
+static int writer_done, late_readers;
+
+static uthread_barrier_t barrier;
+static int arrived[PHASES];
+static int serial, ahead;
+
+static uthread_once_t once = UTHREAD_ONCE_INIT;
+static int init_runs, init_seen;
+
+int reader(void)
+{
+	uthread_rwlock_rdlock(&rwlock);
+	inside++;
+	if (inside > max_inside)
+		max_inside = inside;
+	uthread_yield();
+	inside--;
+	uthread_rwlock_unlock(&rwlock);
+	return 0;
+}
+
+int writer(void)
+{
+	uthread_rwlock_wrlock(&rwlock);
+	/* no reader may be inside with us */
+	if (inside != 0)
+		exit(1);
+	writer_done = 1;
+	uthread_rwlock_unlock(&rwlock);
+	return 0;
+}
+
+int late_reader(void)
+{
+	uthread_rwlock_rdlock(&rwlock);
+	/* the writer which arrived first went first */
+	if (writer_done)
+		late_readers++;
+	uthread_rwlock_unlock(&rwlock);
+	return 0;
+}
+
+int phaser(void)
+{
+	for (int phase = 0; phase < PHASES; phase++) {
+		arrived[phase]++;
+		if (uthread_barrier_wait(&barrier) == UTHREAD_BARRIER_SERIAL_THREAD)
+			serial++;
+		/* everybody reached the barrier before it released us */
+		if (arrived[phase] != BARRIER_THREADS)
+			ahead++;
+	}
+	return 0;
+}
+
+static void init(void)
+{
+	/* the other threads find the initialization running */
+	uthread_yield();
+	init_runs++;
+}
+
+int initializer(void)
+{
+	uthread_once(&once, init);
+	if (init_runs == 1)
+		init_seen++;
+	return 0;
+}
+
+int main(void)
+{
+	static uthread_t tids[BARRIER_THREADS];
+	int i;
+
+	uthread_start(0);
+
+	/* readers share the lock */
+	for (i = 0; i < READERS; i++)
+		tids[i] = uthread_create(reader);
+	uthread_join_all(tids, READERS, NULL);
+	TEST_ASSERT(max_inside == READERS);
+
+	/* a waiting writer goes before the readers arriving after it */
+	TEST_ASSERT(uthread_rwlock_rdlock(&rwlock) == 0);
+	tids[0] = uthread_create(writer);
+	uthread_yield();
+	TEST_ASSERT(uthread_rwlock_tryrdlock(&rwlock) == -1);
+	TEST_ASSERT(uthread_rwlock_trywrlock(&rwlock) == -1);
+	for (i = 1; i <= READERS; i++)
+		tids[i] = uthread_create(late_reader);
+	uthread_yield();
+	TEST_ASSERT(writer_done == 0);
+	uthread_rwlock_unlock(&rwlock);
+	uthread_join_all(tids, READERS + 1, NULL);
+	TEST_ASSERT(late_readers == READERS);
+	TEST_ASSERT(uthread_rwlock_trywrlock(&rwlock) == 0);
+	TEST_ASSERT(uthread_rwlock_tryrdlock(&rwlock) == -1);
+	uthread_rwlock_unlock(&rwlock);
+
+	/* a thousand threads, several phases */
+	TEST_ASSERT(uthread_barrier_init(&barrier, 0) == -1);
+	uthread_barrier_init(&barrier, BARRIER_THREADS);
+	for (i = 0; i < BARRIER_THREADS; i++)
+		tids[i] = uthread_create(phaser);
+	uthread_join_all(tids, BARRIER_THREADS, NULL);
+	TEST_ASSERT(serial == PHASES);
+	TEST_ASSERT(ahead == 0);
+
+	/* a single run, seen by every caller */
+	for (i = 0; i < READERS; i++)
+		tids[i] = uthread_create(initializer);
+	uthread_join_all(tids, READERS, NULL);
+	TEST_ASSERT(init_runs == 1);
+	TEST_ASSERT(init_seen == READERS);
+	uthread_once(&once, init);
+	TEST_ASSERT(init_runs == 1);
+	TEST_ASSERT(uthread_once(NULL, init) == -1);
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,481 @@
+/*
+ * Scheduling stress and fairness harness
+ *
+ * Runs the same workloads without preemption, then with preemption, each in a
+ * child process of its own so that memory measurements do not mix:
+ *
+ * - scale: up to the TID limit of threads at once, a third of them CPU-bound,
+ *   a third yielding in a loop and a third sleeping, measuring the time per
+ *   thread and the peak RSS per thread;
+ * - fairness: CPU-bound threads spin for a fixed time, and Jain's fairness
+ *   index of the CPU shares they got is computed;
+ * - latency: threads sleep 1 ms at a time next to CPU-bound threads, and how
+ *   late they are woken up goes to a log-linear (HDR-style) histogram.
+ *
+ * The results are compared to the baselines recorded in a file, and any
+ * regression beyond a tolerance makes the harness fail. Run it with -w on a
+ * new machine to record its baselines.
+ *
+ * Usage: uthread_stress.x [-n threads] [-b baseline] [-w]
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+/* Highest number of threads alive at once, every TID but the main one */
+#define STRESS_THREADS USHRT_MAX
+/* Rounds of work of each thread of the scale workload */
+#define SCALE_ROUNDS 8
+/* Iterations of a CPU-bound round */
+#define SCALE_SPIN 2000
+/* Threads and duration of the fairness workload */
+#define FAIR_THREADS 8
+#define FAIR_MS 800
+/* Sleeping threads, sleeps, and CPU-bound threads of the latency workload */
+#define LAT_THREADS 16
+#define LAT_SLEEPS 40
+#define LAT_HOGS 4
+
+#define BASELINE_PATH "uthread_stress.baseline"
+
+/* Histogram buckets: 16 sub-buckets per power of two, about 6% precision */
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+struct hist {
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t count;
+	uint64_t max;
+};
+
+/* Results of a mode, written by its child process */
+struct results {
+	int threads;
+	double scale_us_per_thread;
+	double rss_kb_per_thread;
+	double fairness;
+	double latency_p50_us;
+	double latency_p99_us;
+	double latency_max_us;
+};
+
+/*
+ * A metric compared to its baseline: a regression is a value worse than the
+ * baseline by more than @slack times it plus @margin
+ */
+struct metric {
+	const char *name;
+	size_t offset;
+	/* 1 if higher is better */
+	int higher;
+	double slack;
+	double margin;
+};
+
+static const struct metric metrics[] = {
+	{ "scale_us_per_thread", offsetof(struct results, scale_us_per_thread),
+	  0, 2.0, 1.0 },
+	{ "rss_kb_per_thread", offsetof(struct results, rss_kb_per_thread),
+	  0, 0.25, 1.0 },
+	{ "fairness", offsetof(struct results, fairness), 1, 0, 0.1 },
+	{ "latency_p99_us", offsetof(struct results, latency_p99_us),
+	  0, 1.0, 2000 },
+};
+
+static const char *modes[] = { "coop", "preempt" };
+
+static int preempt;
+static volatile int stop;
+static int alive;
+static unsigned long fair_work[FAIR_THREADS];
+static struct hist latency;
+static volatile unsigned long sink;
+
+static uint64_t clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int hist_index(uint64_t value)
+{
+	int shift;
+
+	if (value < 2 * HIST_SUB)
+		return value;
+
+	/* keep the HIST_SUB_BITS bits below the most significant one */
+	shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+	return HIST_SUB * shift + (value >> shift);
+}
+
+/* highest value counted in a bucket */
+static uint64_t hist_value(int index)
+{
+	int shift;
+
+	if (index < 2 * HIST_SUB)
+		return index;
+
+	shift = index / HIST_SUB - 1;
+	return ((uint64_t)(index % HIST_SUB + HIST_SUB + 1) << shift) - 1;
+}
+
+static void hist_record(struct hist *h, uint64_t value)
+{
+	h->counts[hist_index(value)]++;
+	h->count++;
+	if (value > h->max)
+		h->max = value;
+}
+
+static uint64_t hist_percentile(const struct hist *h, double percentile)
+{
+	uint64_t rank = h->count * percentile / 100, seen = 0;
+
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen > rank)
+			return hist_value(i) < h->max ? hist_value(i) : h->max;
+	}
+	return h->max;
+}
+
+/* some work the compiler cannot remove */
+static unsigned long spin(unsigned long n)
+{
+	unsigned long x = n;
+
+	for (unsigned long i = 0; i < n; i++)
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+	sink = x;
+	return n;
+}
+
+int cpu_bound(void)
+{
+	alive++;
+	for (int i = 0; i < SCALE_ROUNDS; i++) {
+		spin(SCALE_SPIN);
+		/* with preemption, the timer takes the CPU back */
+		if (!preempt)
+			uthread_yield();
+	}
+	return 0;
+}
+
+int yielder(void)
+{
+	alive++;
+	for (int i = 0; i < SCALE_ROUNDS; i++)
+		uthread_yield();
+	return 0;
+}
+
+int sleeper(void)
+{
+	/* not rand(), its lock may be held by a preempted thread */
+	unsigned int seed = uthread_self();
+
+	alive++;
+	for (int i = 0; i < SCALE_ROUNDS; i++) {
+		seed = seed * 1103515245 + 12345;
+		uthread_sleep(seed % 1000);
+	}
+	return 0;
+}
+
+static void scale(int n, struct results *res)
+{
+	static uthread_func_t kinds[] = { cpu_bound, yielder, sleeper };
+	uthread_t *tids = malloc(n * sizeof(uthread_t));
+	uint64_t start = clock_ns();
+	int i;
+
+	if (tids == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (i = 0; i < n; i++) {
+		int tid = uthread_create(kinds[i % 3]);
+
+		if (tid == -1) {
+			fprintf(stderr, "scale: thread %d not created\n", i);
+			exit(1);
+		}
+		tids[i] = tid;
+	}
+	uthread_join_all(tids, n, NULL);
+
+	if (alive != n) {
+		fprintf(stderr, "scale: %d of %d threads ran\n", alive, n);
+		exit(1);
+	}
+	res->threads = n;
+	res->scale_us_per_thread = (clock_ns() - start) / 1e3 / n;
+	free(tids);
+}
+
+static int fair_thread(int index)
+{
+	while (!stop) {
+		fair_work[index] += spin(1000);
+		if (!preempt)
+			uthread_yield();
+	}
+	return 0;
+}
+
+#define FAIR_ENTRY(i) int fair_##i(void) { return fair_thread(i); }
+FAIR_ENTRY(0) FAIR_ENTRY(1) FAIR_ENTRY(2) FAIR_ENTRY(3)
+FAIR_ENTRY(4) FAIR_ENTRY(5) FAIR_ENTRY(6) FAIR_ENTRY(7)
+
+static void fairness(struct results *res)
+{
+	static uthread_func_t entries[FAIR_THREADS] = {
+		fair_0, fair_1, fair_2, fair_3, fair_4, fair_5, fair_6, fair_7
+	};
+	uthread_t tids[FAIR_THREADS];
+	double sum = 0, squares = 0;
+	int i;
+
+	stop = 0;
+	for (i = 0; i < FAIR_THREADS; i++)
+		tids[i] = uthread_create(entries[i]);
+	uthread_sleep(FAIR_MS * 1000);
+	stop = 1;
+	uthread_join_all(tids, FAIR_THREADS, NULL);
+
+	/* Jain's index: 1 when all shares are equal, 1/n when one takes all */
+	for (i = 0; i < FAIR_THREADS; i++) {
+		sum += fair_work[i];
+		squares += (double)fair_work[i] * fair_work[i];
+	}
+	res->fairness = sum * sum / (FAIR_THREADS * squares);
+}
+
+int hog(void)
+{
+	while (!stop) {
+		spin(1000);
+		if (!preempt)
+			uthread_yield();
+	}
+	return 0;
+}
+
+int late_sleeper(void)
+{
+	for (int i = 0; i < LAT_SLEEPS; i++) {
+		uint64_t target = clock_ns() + 1000000;
+
+		uthread_sleep(1000);
+		hist_record(&latency, clock_ns() - target);
+	}
+	return 0;
+}
+
+static void wakeup_latency(struct results *res)
+{
+	uthread_t sleepers[LAT_THREADS], hogs[LAT_HOGS];
+	int i;
+
+	stop = 0;
+	for (i = 0; i < LAT_HOGS; i++)
+		hogs[i] = uthread_create(hog);
+	for (i = 0; i < LAT_THREADS; i++)
+		sleepers[i] = uthread_create(late_sleeper);
+	uthread_join_all(sleepers, LAT_THREADS, NULL);
+	stop = 1;
+	uthread_join_all(hogs, LAT_HOGS, NULL);
+
+	res->latency_p50_us = hist_percentile(&latency, 50) / 1e3;
+	res->latency_p99_us = hist_percentile(&latency, 99) / 1e3;
+	res->latency_max_us = latency.max / 1e3;
+}
+
+/* run the workloads of a mode in a child process */
+static void run_mode(int mode, int n, struct results *res)
+{
+	struct rusage usage;
+	int status;
+	pid_t pid;
+
+	/* the child must not print what the parent did not flush yet */
+	fflush(stdout);
+	pid = fork();
+
+	if (pid == -1) {
+		perror("fork");
+		exit(1);
+	}
+
+	if (pid == 0) {
+		preempt = mode;
+		uthread_start(preempt);
+		scale(n, res);
+		fairness(res);
+		wakeup_latency(res);
+		uthread_stop();
+		exit(0);
+	}
+
+	if (wait4(pid, &status, 0, &usage) == -1) {
+		perror("wait4");
+		exit(1);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s: workloads failed\n", modes[mode]);
+		exit(1);
+	}
+	res->rss_kb_per_thread = (double)usage.ru_maxrss / n;
+}
+
+static double *metric_of(struct results *res, const struct metric *m)
+{
+	return (double*)((char*)res + m->offset);
+}
+
+static void baseline_write(const char *path, struct results *res)
+{
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	fprintf(f, "# uthread_stress.x baselines, recorded with -w\n");
+	for (int mode = 0; mode < 2; mode++) {
+		for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++)
+			fprintf(f, "%s.%s %.3f\n", modes[mode], metrics[i].name,
+				*metric_of(&res[mode], &metrics[i]));
+	}
+	fclose(f);
+	printf("baselines written to %s\n", path);
+}
+
+/* Return: the number of regressions, -1 if there is no baseline file */
+static int baseline_check(const char *path, struct results *res)
+{
+	char line[128], key[64];
+	double base;
+	int regressions = 0;
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#' || sscanf(line, "%63s %lf", key, &base) != 2)
+			continue;
+
+		for (int mode = 0; mode < 2; mode++) {
+			size_t len = strlen(modes[mode]);
+
+			if (strncmp(key, modes[mode], len) != 0 || key[len] != '.')
+				continue;
+
+			for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]);
+			     i++) {
+				const struct metric *m = &metrics[i];
+				double value = *metric_of(&res[mode], m);
+				double limit;
+				int bad;
+
+				if (strcmp(key + len + 1, m->name) != 0)
+					continue;
+
+				if (m->higher) {
+					limit = base * (1 - m->slack) - m->margin;
+					bad = value < limit;
+				} else {
+					limit = base * (1 + m->slack) + m->margin;
+					bad = value > limit;
+				}
+				printf("%-8s %-20s %10.3f  baseline %10.3f  limit %10.3f%s\n",
+				       modes[mode], m->name, value, base, limit,
+				       bad ? "  REGRESSION" : "");
+				regressions += bad;
+			}
+		}
+	}
+	fclose(f);
+
+	return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = BASELINE_PATH;
+	struct results *res;
+	int n = STRESS_THREADS, write = 0, opt, regressions;
+
+	while ((opt = getopt(argc, argv, "n:b:w")) != -1) {
+		if (opt == 'n')
+			n = atoi(optarg);
+		else if (opt == 'b')
+			path = optarg;
+		else if (opt == 'w')
+			write = 1;
+		else
+			n = -1;
+	}
+	if (n <= 0 || n > STRESS_THREADS || optind != argc) {
+		fprintf(stderr, "usage: %s [-n threads] [-b baseline] [-w]\n",
+			argv[0]);
+		return 1;
+	}
+
+	/* shared with the children, which fill in the results */
+	res = mmap(NULL, 2 * sizeof(struct results), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	for (int mode = 0; mode < 2; mode++) {
+		run_mode(mode, n, &res[mode]);
+		printf("%s: %d threads, %.2f us and %.1f KB per thread, "
+		       "fairness %.4f, wakeup latency p50 %.0f us p99 %.0f us "
+		       "max %.0f us\n", modes[mode], res[mode].threads,
+		       res[mode].scale_us_per_thread, res[mode].rss_kb_per_thread,
+		       res[mode].fairness, res[mode].latency_p50_us,
+		       res[mode].latency_p99_us, res[mode].latency_max_us);
+	}
+
+	if (write) {
+		baseline_write(path, res);
+		return 0;
+	}
+
+	/* baselines hold for the default number of threads only */
+	regressions = n == STRESS_THREADS ? baseline_check(path, res) : -1;
+	if (regressions == -1) {
+		printf("no baseline to compare to\n");
+		return 0;
+	}
+	if (regressions > 0) {
+		printf("FAIL: %d regressions\n", regressions);
+		return 1;
+	}
+	printf("PASS: no regression\n");
+
+	return 0;
+}
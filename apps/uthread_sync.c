@@ -0,0 +1,142 @@
+/*
+ * Park, mutex and condition variable test
+ *
+ * Threads increment a shared counter in a critical section which yields in
+ * the middle, so that the mutex is always contended. A producer and consumers
+ * exchange items through a condition variable, and a consumer blocked on it is
+ * cancelled. Finally uthread_park() must not sleep on a stale value.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define THREADS 8
+#define ROUNDS 1000
+#define ITEMS 100
+
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static uthread_cond_t cond = UTHREAD_COND_INITIALIZER;
+static int counter;
+static int items, consumed, done;
+static int flag;
+
+int incrementer(void)
+{
+	for (int i = 0; i < ROUNDS; i++) {
+		uthread_mutex_lock(&mutex);
+		int value = counter;
+		uthread_yield();
+		counter = value + 1;
+		uthread_mutex_unlock(&mutex);
+	}
+	return 0;
+}
+
+int consumer(void)
+{
+	uthread_mutex_lock(&mutex);
+	while (1) {
+		while (items == 0 && !done)
+			uthread_cond_wait(&cond, &mutex);
+		if (items == 0)
+			break;
+		items--;
+		consumed++;
+	}
+	uthread_mutex_unlock(&mutex);
+	return 0;
+}
+
+int producer(void)
+{
+	for (int i = 0; i < ITEMS; i++) {
+		uthread_mutex_lock(&mutex);
+		items++;
+		uthread_cond_signal(&cond);
+		uthread_mutex_unlock(&mutex);
+		uthread_yield();
+	}
+	uthread_mutex_lock(&mutex);
+	done = 1;
+	uthread_cond_broadcast(&cond);
+	uthread_mutex_unlock(&mutex);
+	return 0;
+}
+
+static void unlock(void *arg)
+{
+	uthread_mutex_unlock(arg);
+}
+
+int waiter(void)
+{
+	uthread_mutex_lock(&mutex);
+	uthread_cleanup_push(unlock, &mutex);
+	while (1)
+		uthread_cond_wait(&cond, &mutex);
+	return 0;
+}
+
+int parker(void)
+{
+	while (flag == 0)
+		uthread_park(&flag, 0);
+	return flag;
+}
+
+int main(void)
+{
+	uthread_t tids[THREADS];
+	int i, retval;
+
+	uthread_start(0);
+
+	for (i = 0; i < THREADS; i++)
+		tids[i] = uthread_create(incrementer);
+	uthread_join_all(tids, THREADS, NULL);
+	TEST_ASSERT(counter == THREADS * ROUNDS);
+
+	for (i = 0; i < THREADS - 1; i++)
+		tids[i] = uthread_create(consumer);
+	tids[i] = uthread_create(producer);
+	uthread_join_all(tids, THREADS, NULL);
+	TEST_ASSERT(consumed == ITEMS);
+
+	/* a cancelled waiter unlocks the mutex in its cleanup handler */
+	tids[0] = uthread_create(waiter);
+	uthread_yield();
+	uthread_cancel(tids[0]);
+	uthread_join(tids[0], &retval);
+	TEST_ASSERT(retval == UTHREAD_CANCELED);
+	TEST_ASSERT(uthread_mutex_trylock(&mutex) == 0);
+	TEST_ASSERT(uthread_mutex_trylock(&mutex) == -1);
+	uthread_mutex_unlock(&mutex);
+
+	TEST_ASSERT(uthread_park(&flag, 1) == -1);
+	TEST_ASSERT(uthread_unpark(&flag, INT_MAX) == 0);
+	tids[0] = uthread_create(parker);
+	tids[1] = uthread_create(parker);
+	uthread_yield();
+	flag = 5;
+	TEST_ASSERT(uthread_unpark(&flag, INT_MAX) == 2);
+	uthread_join(tids[0], &retval);
+	TEST_ASSERT(retval == 5);
+	uthread_join(tids[1], NULL);
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Thread-specific data test
+ *
+ * Threads store their own values under the same keys, both inline keys and
+ * keys stored in the spillover array, and check that they never see the
+ * values of other threads. Destructors must run once per non-NULL value when
+ * the threads exit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define THREADS 4
+#define KEYS 12
+
+static uthread_key_t keys[KEYS];
+static int destroyed;
+
+static void destructor(void *value)
+{
+	(void)value;
+	destroyed++;
+}
+
+int thread(void)
+{
+	long self = uthread_self();
+	int i;
+
+	for (i = 0; i < KEYS; i++) {
+		if (uthread_getspecific(keys[i]) != NULL)
+			exit(1);
+		uthread_setspecific(keys[i], (void*)(self * 100 + i));
+	}
+
+	/* let the other threads set their own values */
+	uthread_yield();
+
+	for (i = 0; i < KEYS; i++) {
+		if (uthread_getspecific(keys[i]) != (void*)(self * 100 + i)) {
+			printf("thread%ld: wrong value for key %d\n", self, i);
+			exit(1);
+		}
+	}
+
+	/* a NULL value is not destroyed */
+	uthread_setspecific(keys[0], NULL);
+	return 0;
+}
+
+int main(void)
+{
+	int tids[THREADS];
+	int i;
+
+	uthread_start(0);
+
+	for (i = 0; i < KEYS; i++)
+		uthread_key_create(&keys[i], destructor);
+
+	for (i = 0; i < THREADS; i++)
+		tids[i] = uthread_create(thread);
+	for (i = 0; i < THREADS; i++)
+		uthread_join(tids[i], NULL);
+
+	printf("destroyed %d values\n", destroyed);
+	if (destroyed != THREADS * (KEYS - 1))
+		exit(1);
+
+	if (uthread_setspecific(KEYS + 100, NULL) != -1 ||
+	    uthread_getspecific(KEYS + 100) != NULL)
+		exit(1);
+
+	uthread_stop();
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * uthread_top - Display the threads of a running libuthread program
+ *
+ * Maps read-only the shared memory segment published by a process which
+ * called uthread_monitor_start(), and refreshes a table of its threads like
+ * top(1): state, share of the CPU since the previous refresh, total CPU time
+ * and preemptions, busiest threads first.
+ *
+ * Usage: uthread_top.x [-d delay_ms] [-n refreshes] pid
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <monitor.h>
+
+/* Number of threads displayed */
+#define TOP_ROWS 20
+/* Slots of the previous CPU times, one per TID */
+#define TOP_TIDS 65536
+
+struct row {
+	struct uthread_monitor_thread thread;
+	double cpu;
+};
+
+/* CPU time of each thread at the previous refresh, by TID */
+static uint64_t prev_handle[TOP_TIDS];
+static uint64_t prev_run_time[TOP_TIDS];
+static uint64_t prev_time;
+
+static const char *state_names[] = { "run", "ready", "block", "zombie" };
+
+static uint64_t clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-d delay_ms] [-n refreshes] pid\n", name);
+	exit(1);
+}
+
+/* copy the segment while the scheduler is not writing it */
+static void snapshot(const struct uthread_monitor *segment,
+		     struct uthread_monitor *copy, size_t size)
+{
+	uint32_t seq;
+
+	while (1) {
+		seq = __atomic_load_n(&segment->seq, __ATOMIC_ACQUIRE);
+		if (seq % 2 == 0) {
+			memcpy(copy, segment, size);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&segment->seq, __ATOMIC_RELAXED) == seq)
+				return;
+		}
+		usleep(100);
+	}
+}
+
+/* busiest threads first, then by TID */
+static int row_compare(const void *a, const void *b)
+{
+	const struct row *x = a, *y = b;
+
+	if (x->cpu != y->cpu)
+		return x->cpu < y->cpu ? 1 : -1;
+	return (x->thread.handle & 0xffff) < (y->thread.handle & 0xffff) ? -1 : 1;
+}
+
+static void display(int pid, const struct uthread_monitor *copy,
+		    struct row *rows)
+{
+	double elapsed = copy->time - prev_time;
+	unsigned int i;
+
+	for (i = 0; i < copy->published; i++) {
+		const struct uthread_monitor_thread *t = &copy->thread[i];
+		unsigned int tid = t->handle & 0xffff;
+
+		rows[i].thread = *t;
+		rows[i].cpu = 0;
+		/* a thread seen at the previous refresh, not a reused TID */
+		if (prev_time != 0 && prev_handle[tid] == t->handle &&
+		    copy->time > prev_time)
+			rows[i].cpu = 100.0 * (t->run_time - prev_run_time[tid]) /
+				elapsed;
+		prev_handle[tid] = t->handle;
+		prev_run_time[tid] = t->run_time;
+	}
+	prev_time = copy->time;
+	qsort(rows, copy->published, sizeof(struct row), row_compare);
+
+	/* redraw in place on a terminal, append otherwise */
+	if (isatty(STDOUT_FILENO))
+		printf("\033[H\033[J");
+
+	printf("pid %d  threads %u  ready %u  preemptions %llu  "
+	       "updated %.1f s ago\n\n", pid, copy->threads, copy->ready,
+	       (unsigned long long)copy->preemptions,
+	       (clock_ns() - copy->time) / 1e9);
+	printf("%6s %8s %-7s %3s %6s %10s %10s\n", "TID", "GEN", "STATE", "DL",
+	       "%CPU", "TIME", "PREEMPT");
+
+	for (i = 0; i < copy->published && i < TOP_ROWS; i++) {
+		const struct uthread_monitor_thread *t = &rows[i].thread;
+
+		printf("%6llu %8llu %-7s %3s %6.1f %9.3fs %10llu\n",
+		       (unsigned long long)(t->handle & 0xffff),
+		       (unsigned long long)(t->handle >> 16),
+		       t->state < 4 ? state_names[t->state] : "?",
+		       t->deadline ? "*" : "", rows[i].cpu, t->run_time / 1e9,
+		       (unsigned long long)t->preemptions);
+	}
+	if (copy->threads > copy->published)
+		printf("... %u threads not published\n",
+		       copy->threads - copy->published);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	struct uthread_monitor *segment, *copy;
+	struct row *rows;
+	struct stat st;
+	char name[32];
+	int delay_ms = 1000, refreshes = -1;
+	int fd, opt, pid;
+
+	while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+		if (opt == 'd')
+			delay_ms = atoi(optarg);
+		else if (opt == 'n')
+			refreshes = atoi(optarg);
+		else
+			usage(argv[0]);
+	}
+	if (optind != argc - 1 || delay_ms <= 0)
+		usage(argv[0]);
+	pid = atoi(argv[optind]);
+
+	snprintf(name, sizeof(name), UTHREAD_MONITOR_NAME, pid);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1) {
+		fprintf(stderr, "%s: no monitor segment for pid %d: %s\n",
+			argv[0], pid, strerror(errno));
+		return 1;
+	}
+	if (fstat(fd, &st) == -1) {
+		perror("fstat");
+		return 1;
+	}
+
+	segment = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	if ((size_t)st.st_size < sizeof(struct uthread_monitor) ||
+	    segment->magic != UTHREAD_MONITOR_MAGIC ||
+	    segment->version != UTHREAD_MONITOR_VERSION) {
+		fprintf(stderr, "%s: %s is not a monitor segment\n", argv[0],
+			name);
+		return 1;
+	}
+
+	copy = malloc(st.st_size);
+	rows = malloc(segment->capacity * sizeof(struct row));
+	if (copy == NULL || rows == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	while (refreshes != 0) {
+		snapshot(segment, copy, st.st_size);
+		display(pid, copy, rows);
+
+		/* the segment keeps its last update once the process exits */
+		if (kill(pid, 0) == -1 && errno == ESRCH) {
+			printf("process %d exited\n", pid);
+			break;
+		}
+		if (refreshes > 0 && --refreshes == 0)
+			break;
+		usleep(delay_ms * 1000);
+	}
+
+	free(rows);
+	free(copy);
+	munmap(segment, st.st_size);
+
+	return 0;
+}
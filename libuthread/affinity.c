@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Memory policy of mbind(), from <numaif.h> which may not be installed */
+#define AFFINITY_MPOL_PREFERRED 1
+
+/* CPUs configured by uthread_affinity_config() */
+static int *cpu_list;
+static int cpu_count;
+
+/* NUMA node of the scheduler thread, -1 when unknown */
+static int sched_node = -1;
+
+static int pin(pthread_t thread, int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	return pthread_setaffinity_np(thread, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int uthread_affinity_config(const int *cpus, int n)
+{
+	unsigned int cpu, node;
+	int *list;
+
+	if (cpus == NULL || n <= 0)
+		return -1;
+
+	for (int i = 0; i < n; i++) {
+		if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE)
+			return -1;
+	}
+
+	list = malloc(n * sizeof(int));
+	if (list == NULL)
+		return -1;
+	for (int i = 0; i < n; i++)
+		list[i] = cpus[i];
+
+	/* the scheduler runs where the caller asked first */
+	if (pin(pthread_self(), list[0]) == -1) {
+		free(list);
+		return -1;
+	}
+
+	free(cpu_list);
+	cpu_list = list;
+	cpu_count = n;
+
+	/* memory of the scheduler is preferably taken from its own node */
+	sched_node = -1;
+	if (getcpu(&cpu, &node) == 0)
+		sched_node = node;
+
+	return 0;
+}
+
+void affinity_pin_helper(pthread_t thread, int index)
+{
+	if (cpu_count == 0)
+		return;
+
+	/* helpers share the CPUs left after the scheduler, if there are any */
+	if (cpu_count == 1)
+		pin(thread, cpu_list[0]);
+	else
+		pin(thread, cpu_list[1 + index % (cpu_count - 1)]);
+}
+
+void affinity_bind(void *addr, size_t len)
+{
+	unsigned long mask;
+
+	/* first-touch by the scheduler is all there is beyond 64 nodes */
+	if (sched_node < 0 || sched_node >= 64)
+		return;
+
+	/* pages not touched yet will come from the node of the scheduler */
+	mask = 1UL << sched_node;
+	syscall(SYS_mbind, addr, len, AFFINITY_MPOL_PREFERRED, &mask,
+		sizeof(mask) * 8, 0);
+}
+
+void affinity_stop(void)
+{
+	free(cpu_list);
+	cpu_list = NULL;
+	cpu_count = 0;
+	sched_node = -1;
+}
@@ -0,0 +1,151 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Size of the chunks arenas are made of, header included */
+#define ARENA_CHUNK 4096
+
+/* Allocations above this size get a chunk of their own */
+#define ARENA_LARGE (ARENA_CHUNK / 4)
+
+/* Alignment of the allocations */
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t used;
+	size_t size;
+	_Alignas(max_align_t) char data[];
+};
+
+/* chunks released by exited threads, shared by all the arenas */
+static struct arena_chunk *chunk_pool;
+
+static struct arena_chunk *chunk_alloc(size_t size)
+{
+	struct arena_chunk *chunk = malloc(sizeof(struct arena_chunk) + size);
+
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->used = 0;
+	chunk->size = size;
+
+	return chunk;
+}
+
+void uthread_arena_init(struct TCB *tcb)
+{
+	tcb->arena = NULL;
+	tcb->arena_tail = NULL;
+	tcb->arena_large = NULL;
+}
+
+void uthread_arena_exit(struct TCB *tcb)
+{
+	struct arena_chunk *chunk;
+
+	/* the regular chunks go back to the pool at once */
+	if (tcb->arena != NULL) {
+		tcb->arena_tail->next = chunk_pool;
+		chunk_pool = tcb->arena;
+	}
+
+	while ((chunk = tcb->arena_large) != NULL) {
+		tcb->arena_large = chunk->next;
+		free(chunk);
+	}
+
+	uthread_arena_init(tcb);
+}
+
+void uthread_arena_release(void)
+{
+	struct arena_chunk *chunk;
+
+	while ((chunk = chunk_pool) != NULL) {
+		chunk_pool = chunk->next;
+		free(chunk);
+	}
+}
+
+/* allocate from a chunk of its own, preemption must be disabled */
+static void *arena_large(struct TCB *tcb, size_t size)
+{
+	struct arena_chunk *chunk = chunk_alloc(size);
+
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->used = size;
+	chunk->next = tcb->arena_large;
+	tcb->arena_large = chunk;
+
+	return chunk->data;
+}
+
+/* start a new regular chunk, preemption must be disabled */
+static struct arena_chunk *arena_grow(struct TCB *tcb)
+{
+	struct arena_chunk *chunk = chunk_pool;
+
+	if (chunk != NULL) {
+		chunk_pool = chunk->next;
+		chunk->used = 0;
+	} else {
+		chunk = chunk_alloc(ARENA_CHUNK - sizeof(struct arena_chunk));
+		if (chunk == NULL)
+			return NULL;
+	}
+
+	/* the current chunk is at the head, the list is released as a whole */
+	chunk->next = tcb->arena;
+	tcb->arena = chunk;
+	if (tcb->arena_tail == NULL)
+		tcb->arena_tail = chunk;
+
+	return chunk;
+}
+
+void *uthread_arena_alloc(size_t size)
+{
+	struct TCB *tcb = uthread_current();
+	struct arena_chunk *chunk;
+	void *ptr;
+
+	if (tcb == NULL || size == 0)
+		return NULL;
+
+	/* rounding up and adding the chunk header must not wrap around */
+	if (size > SIZE_MAX - ARENA_ALIGN - sizeof(struct arena_chunk))
+		return NULL;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	/* fast path, the arena belongs to the thread and needs no protection */
+	chunk = tcb->arena;
+	if (chunk != NULL && chunk->size - chunk->used >= size) {
+		ptr = chunk->data + chunk->used;
+		chunk->used += size;
+		return ptr;
+	}
+
+	/* the chunk pool is shared */
+	preempt_disable();
+	if (size > ARENA_LARGE) {
+		ptr = arena_large(tcb, size);
+	} else {
+		chunk = arena_grow(tcb);
+		ptr = NULL;
+		if (chunk != NULL) {
+			ptr = chunk->data;
+			chunk->used = size;
+		}
+	}
+	preempt_enable();
+
+	return ptr;
+}
@@ -1,12 +1,27 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "private.h"
 #include "uthread.h"
 
-/* Size of the stack for a thread (in bytes) */
-#define UTHREAD_STACK_SIZE 32768
+/* Alignment of the stacks, so that they can be bound to a NUMA node */
+#define UTHREAD_STACK_ALIGN 4096
 
+/* Maximum number of free stacks kept for reuse */
+#define UTHREAD_STACK_POOL 64
+
+/* free stacks, linked through their first word */
+static void *stack_pool;
+static int stack_pool_count;
+
+#ifdef UTHREAD_COOP
+void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
+{
+	/* only the registers are saved, there is no signal mask to switch */
+	uthread_stack_ctx_switch(prev, next);
+}
+#else
 void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 {
 	/*
@@ -18,17 +33,52 @@ void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 		exit(1);
 	}
 }
+#endif
 
 void *uthread_ctx_alloc_stack(void)
 {
-	return malloc(UTHREAD_STACK_SIZE);
+	void *stack = stack_pool;
+
+	if (stack == NULL) {
+		stack = aligned_alloc(UTHREAD_STACK_ALIGN, UTHREAD_STACK_SIZE);
+		if (stack != NULL)
+			affinity_bind(stack, UTHREAD_STACK_SIZE);
+		return stack;
+	}
+
+	stack_pool = *(void**)stack;
+	stack_pool_count--;
+
+	return stack;
 }
 
 void uthread_ctx_destroy_stack(void *top_of_stack)
 {
+	if (top_of_stack == NULL)
+		return;
+
+	/* keep the stack for the next thread or generator */
+	if (stack_pool_count < UTHREAD_STACK_POOL) {
+		*(void**)top_of_stack = stack_pool;
+		stack_pool = top_of_stack;
+		stack_pool_count++;
+		return;
+	}
+
 	free(top_of_stack);
 }
 
+void uthread_ctx_release_stacks(void)
+{
+	void *stack;
+
+	while ((stack = stack_pool) != NULL) {
+		stack_pool = *(void**)stack;
+		free(stack);
+	}
+	stack_pool_count = 0;
+}
+
 /*
  * uthread_ctx_bootstrap - Thread context bootstrap function
  * @func: Function to be executed by the new thread
@@ -44,6 +94,20 @@ static void uthread_ctx_bootstrap(uthread_func_t func)
 	uthread_exit(func());
 }
 
+#ifdef UTHREAD_COOP
+/* entry of the register-only contexts, whose argument is a pointer */
+static void uthread_ctx_bootstrap_arg(void *func)
+{
+	uthread_ctx_bootstrap((uthread_func_t)func);
+}
+
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
+		     uthread_func_t func)
+{
+	return uthread_stack_ctx_make(uctx, top_of_stack,
+				      uthread_ctx_bootstrap_arg, (void*)func);
+}
+#else
 int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 		     uthread_func_t func)
 {
@@ -69,4 +133,103 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 
 	return 0;
 }
+#endif
 
+#if defined(__x86_64__)
+/*
+ * Save the callee-saved registers, with the x87 and SSE control words, on the
+ * stack being left, store its pointer in @prev (%rdi) and pop the registers
+ * of @next (%rsi) from its own stack. A new stack returns into
+ * uthread_stack_start(), which calls the entry function (%r12) with its
+ * argument (%r13).
+ */
+__asm__(
+	".pushsection .text\n"
+	".globl uthread_stack_ctx_switch\n"
+	".type uthread_stack_ctx_switch, @function\n"
+	"uthread_stack_ctx_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $16, %rsp\n"
+	"	fnstcw (%rsp)\n"
+	"	stmxcsr 8(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq (%rsi), %rsp\n"
+	"	fldcw (%rsp)\n"
+	"	ldmxcsr 8(%rsp)\n"
+	"	addq $16, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size uthread_stack_ctx_switch, .-uthread_stack_ctx_switch\n"
+	"uthread_stack_start:\n"
+	"	movq %r13, %rdi\n"
+	"	callq *%r12\n"
+	"	ud2\n"
+	".popsection\n"
+);
+
+void uthread_stack_start(void);
+
+int uthread_stack_ctx_make(uthread_stack_ctx_t *sctx, void *top_of_stack,
+			   void (*entry)(void *), void *arg)
+{
+	/* the entry function is called with a 16-byte aligned stack */
+	uintptr_t end = ((uintptr_t)top_of_stack + UTHREAD_STACK_SIZE) & ~15UL;
+	uint64_t *frame = (uint64_t*)end - 9;
+	uint16_t fpu_cw;
+	uint32_t mxcsr;
+
+	/* the new context inherits the floating point modes of its creator */
+	__asm__ volatile ("fnstcw %0" : "=m" (fpu_cw));
+	__asm__ volatile ("stmxcsr %0" : "=m" (mxcsr));
+
+	/* popped by uthread_stack_ctx_switch(), from the lowest address */
+	frame[0] = fpu_cw;
+	frame[1] = mxcsr;
+	frame[2] = 0;				/* r15 */
+	frame[3] = 0;				/* r14 */
+	frame[4] = (uintptr_t)arg;		/* r13 */
+	frame[5] = (uintptr_t)entry;		/* r12 */
+	frame[6] = 0;				/* rbx */
+	frame[7] = 0;				/* rbp */
+	frame[8] = (uintptr_t)uthread_stack_start;
+
+	sctx->sp = frame;
+
+	return 0;
+}
+#else
+int uthread_stack_ctx_make(uthread_stack_ctx_t *sctx, void *top_of_stack,
+			   void (*entry)(void *), void *arg)
+{
+	if (getcontext(sctx))
+		return -1;
+
+	sctx->uc_stack.ss_sp = top_of_stack;
+	sctx->uc_stack.ss_size = UTHREAD_STACK_SIZE;
+	sctx->uc_link = NULL;
+
+	makecontext(sctx, (void (*)(void)) entry, 1, arg);
+
+	return 0;
+}
+
+void uthread_stack_ctx_switch(uthread_stack_ctx_t *prev,
+			      uthread_stack_ctx_t *next)
+{
+	/* no register-only switch for this architecture, keep the mask too */
+	if (swapcontext(prev, next)) {
+		perror("swapcontext");
+		exit(1);
+	}
+}
+#endif
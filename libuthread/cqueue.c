@@ -0,0 +1,220 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cqueue.h"
+
+/* Size of a cache line, producers and consumers each own one */
+#define CACHE_LINE 64
+
+/*
+ * A cell is free for the producer of position p when its sequence is p, and
+ * filled for the consumer of position p when its sequence is p + 1. Consuming
+ * it makes it free for position p + capacity.
+ */
+struct cell {
+	atomic_size_t sequence;
+	void *data;
+};
+
+struct cqueue {
+	struct cell *cells;
+	size_t mask;
+	/* next position to enqueue, only touched by producers */
+	_Alignas(CACHE_LINE) atomic_size_t enqueue_pos;
+	/* next position to dequeue, only touched by consumers */
+	_Alignas(CACHE_LINE) atomic_size_t dequeue_pos;
+};
+
+cqueue_t cqueue_create(unsigned int capacity)
+{
+	size_t size = 1;
+
+	if (capacity == 0)
+		return NULL;
+
+	while (size < capacity)
+		size = size * 2;
+
+	struct cqueue *Q = aligned_alloc(CACHE_LINE, sizeof(struct cqueue));
+
+	/* malloc failed */
+	if (Q == NULL)
+		return NULL;
+
+	Q->cells = malloc(size * sizeof(struct cell));
+	if (Q->cells == NULL) {
+		free(Q);
+		return NULL;
+	}
+
+	/* every cell is free for the first lap */
+	for (size_t i = 0; i < size; i++)
+		atomic_init(&Q->cells[i].sequence, i);
+	Q->mask = size - 1;
+	atomic_init(&Q->enqueue_pos, 0);
+	atomic_init(&Q->dequeue_pos, 0);
+
+	return Q;
+}
+
+int cqueue_destroy(cqueue_t cqueue)
+{
+	if (cqueue == NULL || cqueue_length(cqueue) > 0)
+		return -1;
+
+	free(cqueue->cells);
+	free(cqueue);
+
+	return 0;
+}
+
+/*
+ * count the cells in the state @lap (0 for free, 1 for filled) starting at
+ * position @pos, up to @max
+ */
+static int cells_ready(cqueue_t cqueue, size_t pos, int max, size_t lap)
+{
+	int n = 0;
+
+	while (n < max) {
+		struct cell *cell = &cqueue->cells[(pos + n) & cqueue->mask];
+		size_t seq = atomic_load_explicit(&cell->sequence,
+						  memory_order_acquire);
+		if (seq != pos + n + lap)
+			break;
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * claim up to @max cells in the state @lap from the position @pos_var
+ *
+ * Return: the number of cells claimed, starting at the position stored in
+ * @pos, 0 if there is no cell in the state @lap
+ */
+static int cells_claim(cqueue_t cqueue, atomic_size_t *pos_var, size_t *pos,
+		       int max, size_t lap)
+{
+	*pos = atomic_load_explicit(pos_var, memory_order_relaxed);
+
+	while (1) {
+		int n = cells_ready(cqueue, *pos, max, lap);
+
+		if (n > 0) {
+			/* on failure @pos is updated with the current position */
+			if (atomic_compare_exchange_weak_explicit(pos_var, pos,
+					*pos + n, memory_order_relaxed,
+					memory_order_relaxed))
+				return n;
+			continue;
+		}
+
+		/* a cell from the previous lap: the queue is full or empty */
+		struct cell *cell = &cqueue->cells[*pos & cqueue->mask];
+		size_t seq = atomic_load_explicit(&cell->sequence,
+						  memory_order_acquire);
+		if ((intptr_t)(seq - (*pos + lap)) < 0)
+			return 0;
+
+		/* another thread claimed the cell first */
+		*pos = atomic_load_explicit(pos_var, memory_order_relaxed);
+	}
+}
+
+int cqueue_try_enqueue(cqueue_t cqueue, void *data)
+{
+	if (data == NULL)
+		return -1;
+
+	return cqueue_try_enqueue_batch(cqueue, &data, 1) == 1 ? 0 : -1;
+}
+
+int cqueue_try_dequeue(cqueue_t cqueue, void **data)
+{
+	if (data == NULL)
+		return -1;
+
+	return cqueue_try_dequeue_batch(cqueue, data, 1) == 1 ? 0 : -1;
+}
+
+int cqueue_try_enqueue_batch(cqueue_t cqueue, void **items, int n)
+{
+	size_t pos;
+	int i, claimed;
+
+	if (cqueue == NULL || items == NULL)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		if (items[i] == NULL)
+			return -1;
+	}
+
+	if (n <= 0)
+		return 0;
+
+	claimed = cells_claim(cqueue, &cqueue->enqueue_pos, &pos, n, 0);
+
+	/* publish the items, consumers see each cell as soon as it is filled */
+	for (i = 0; i < claimed; i++) {
+		struct cell *cell = &cqueue->cells[(pos + i) & cqueue->mask];
+		cell->data = items[i];
+		atomic_store_explicit(&cell->sequence, pos + i + 1,
+				      memory_order_release);
+	}
+
+	return claimed;
+}
+
+int cqueue_try_dequeue_batch(cqueue_t cqueue, void **items, int max)
+{
+	size_t pos;
+	int i, claimed;
+
+	if (cqueue == NULL || items == NULL)
+		return -1;
+
+	if (max <= 0)
+		return 0;
+
+	claimed = cells_claim(cqueue, &cqueue->dequeue_pos, &pos, max, 1);
+
+	/* give the cells back to the producers of the next lap */
+	for (i = 0; i < claimed; i++) {
+		struct cell *cell = &cqueue->cells[(pos + i) & cqueue->mask];
+		items[i] = cell->data;
+		atomic_store_explicit(&cell->sequence, pos + i + cqueue->mask + 1,
+				      memory_order_release);
+	}
+
+	return claimed;
+}
+
+int cqueue_length(cqueue_t cqueue)
+{
+	if (cqueue == NULL)
+		return -1;
+
+	size_t dequeue_pos = atomic_load_explicit(&cqueue->dequeue_pos,
+						  memory_order_relaxed);
+	size_t enqueue_pos = atomic_load_explicit(&cqueue->enqueue_pos,
+						  memory_order_relaxed);
+
+	/* positions are read separately, consumers may look ahead */
+	if ((intptr_t)(enqueue_pos - dequeue_pos) < 0)
+		return 0;
+
+	return enqueue_pos - dequeue_pos;
+}
+
+int cqueue_capacity(cqueue_t cqueue)
+{
+	if (cqueue == NULL)
+		return -1;
+
+	return cqueue->mask + 1;
+}
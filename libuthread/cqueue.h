@@ -0,0 +1,108 @@
+#ifndef _CQUEUE_H
+#define _CQUEUE_H
+
+/*
+ * cqueue_t - Concurrent queue type
+ *
+ * A concurrent queue is a bounded FIFO data structure which can be shared by
+ * any number of kernel threads, both as producers and as consumers, without
+ * external locking. Items are stored in an array whose cells carry a sequence
+ * number telling whether they are free or filled for the current lap, so that
+ * producers and consumers only synchronize on the cells they claim.
+ *
+ * The queue never blocks and never allocates after its creation: operations
+ * fail when the queue is full (enqueue) or empty (dequeue). All operations are
+ * O(1), apart from batch operations which are O(n) in the number of items.
+ */
+typedef struct cqueue* cqueue_t;
+
+/*
+ * cqueue_create - Allocate an empty concurrent queue
+ * @capacity: Minimum number of items the queue can hold
+ *
+ * The capacity of the queue is @capacity rounded up to a power of two.
+ *
+ * Return: Pointer to new empty queue. NULL if @capacity is 0 or in case of
+ * failure when allocating the new queue.
+ */
+cqueue_t cqueue_create(unsigned int capacity);
+
+/*
+ * cqueue_destroy - Deallocate a concurrent queue
+ * @cqueue: Queue to deallocate
+ *
+ * No other thread may use @cqueue while it is destroyed.
+ *
+ * Return: -1 if @cqueue is NULL or if @cqueue is not empty. 0 if @cqueue was
+ * successfully destroyed.
+ */
+int cqueue_destroy(cqueue_t cqueue);
+
+/*
+ * cqueue_try_enqueue - Enqueue data item if there is room
+ * @cqueue: Queue in which to enqueue item
+ * @data: Address of data item to enqueue
+ *
+ * Return: -1 if @cqueue or @data are NULL, or if the queue is full. 0 if @data
+ * was successfully enqueued in @cqueue.
+ */
+int cqueue_try_enqueue(cqueue_t cqueue, void *data);
+
+/*
+ * cqueue_try_dequeue - Dequeue data item if there is one
+ * @cqueue: Queue in which to dequeue item
+ * @data: Address of data pointer where item is received
+ *
+ * Return: -1 if @cqueue or @data are NULL, or if the queue is empty. 0 if
+ * @data was set with the oldest item available in @cqueue.
+ */
+int cqueue_try_dequeue(cqueue_t cqueue, void **data);
+
+/*
+ * cqueue_try_enqueue_batch - Enqueue several data items
+ * @cqueue: Queue in which to enqueue items
+ * @items: Array of data items to enqueue
+ * @n: Number of items in @items
+ *
+ * Enqueue as many items of @items as there is room for, in order, claiming all
+ * their cells at once. The enqueued items are consecutive in the queue.
+ *
+ * Return: -1 if @cqueue or @items are NULL, or if one of the first @n items
+ * is NULL. The number of items enqueued otherwise, from the start of @items.
+ */
+int cqueue_try_enqueue_batch(cqueue_t cqueue, void **items, int n);
+
+/*
+ * cqueue_try_dequeue_batch - Dequeue several data items
+ * @cqueue: Queue in which to dequeue items
+ * @items: Array receiving the dequeued items
+ * @max: Maximum number of items to dequeue
+ *
+ * Dequeue up to @max of the oldest items of @cqueue, claiming all their cells
+ * at once, and store them in @items from the oldest to the newest.
+ *
+ * Return: -1 if @cqueue or @items are NULL. The number of items dequeued
+ * otherwise.
+ */
+int cqueue_try_dequeue_batch(cqueue_t cqueue, void **items, int max);
+
+/*
+ * cqueue_length - Concurrent queue length
+ * @cqueue: Queue to get the length of
+ *
+ * The length is only a snapshot when other threads use the queue.
+ *
+ * Return: -1 if @cqueue is NULL. Length of @cqueue otherwise.
+ */
+int cqueue_length(cqueue_t cqueue);
+
+/*
+ * cqueue_capacity - Concurrent queue capacity
+ * @cqueue: Queue to get the capacity of
+ *
+ * Return: -1 if @cqueue is NULL. Number of items @cqueue can hold otherwise,
+ * the capacity given to cqueue_create() rounded up to a power of two.
+ */
+int cqueue_capacity(cqueue_t cqueue);
+
+#endif /* _CQUEUE_H */
@@ -0,0 +1,358 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Maximum number of events received by a single epoll_wait() */
+#define EVENT_MAX 64
+
+/*
+ * Time in nanoseconds between two polls of the file descriptors while threads
+ * are ready to run
+ */
+#define EVENT_POLL_INTERVAL 50000
+
+/* Initial capacity of the timer heap */
+#define TIMER_CAPACITY 16
+
+static int epoll_fd = -1;
+/* fires at the earliest wake time of the sleeping threads */
+static int timer_fd = -1;
+/* written to wake the event loop up from another kernel thread */
+static int wake_fd = -1;
+
+/* tags of the timer and wakeup file descriptors in epoll events */
+static char timer_tag, wake_tag;
+
+/* min-heap of the sleeping threads, ordered by wake time */
+static struct TCB **timers;
+static int timer_count, timer_capacity;
+/* wake time the timer file descriptor is armed for, 0 if disarmed */
+static uint64_t timer_armed;
+
+/* number of threads waiting for a file descriptor */
+static int fd_waiters;
+/* scheduling time of the last poll of the file descriptors */
+static uint64_t last_poll;
+
+uint64_t event_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void timer_set(int i, struct TCB *tcb)
+{
+	timers[i] = tcb;
+	tcb->timer_index = i;
+}
+
+static void timer_up(int i)
+{
+	struct TCB *tcb = timers[i];
+
+	while (i > 0 && timers[(i - 1) / 2]->wake_time > tcb->wake_time) {
+		timer_set(i, timers[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	timer_set(i, tcb);
+}
+
+static void timer_down(int i)
+{
+	struct TCB *tcb = timers[i];
+
+	while (2 * i + 1 < timer_count) {
+		int child = 2 * i + 1;
+
+		if (child + 1 < timer_count &&
+		    timers[child + 1]->wake_time < timers[child]->wake_time)
+			child++;
+		if (timers[child]->wake_time >= tcb->wake_time)
+			break;
+		timer_set(i, timers[child]);
+		i = child;
+	}
+	timer_set(i, tcb);
+}
+
+static int timer_push(struct TCB *tcb)
+{
+	if (timer_count == timer_capacity) {
+		int capacity = timer_capacity ? timer_capacity * 2 : TIMER_CAPACITY;
+		struct TCB **heap = realloc(timers, capacity * sizeof(struct TCB*));
+
+		/* malloc failed */
+		if (heap == NULL)
+			return -1;
+
+		timers = heap;
+		timer_capacity = capacity;
+	}
+
+	timers[timer_count] = tcb;
+	timer_count++;
+	timer_up(timer_count - 1);
+
+	return 0;
+}
+
+static struct TCB *timer_pop(void)
+{
+	struct TCB *tcb = timers[0];
+
+	timer_count--;
+	if (timer_count > 0) {
+		timers[0] = timers[timer_count];
+		timer_down(0);
+	}
+	tcb->timer_index = -1;
+
+	return tcb;
+}
+
+/* remove a thread from the heap before its wake time */
+static void timer_remove(struct TCB *tcb)
+{
+	int i = tcb->timer_index;
+
+	timer_count--;
+	if (i < timer_count) {
+		struct TCB *last = timers[timer_count];
+
+		timer_set(i, last);
+		timer_up(i);
+		timer_down(last->timer_index);
+	}
+	tcb->timer_index = -1;
+}
+
+/* unblock the sleeping threads whose wake time passed */
+static int timer_expire(void)
+{
+	int woken = 0;
+
+	if (timer_count == 0)
+		return 0;
+
+	uint64_t now = event_clock();
+
+	while (timer_count > 0 && timers[0]->wake_time <= now) {
+		uthread_unblock(timer_pop());
+		woken++;
+	}
+
+	return woken;
+}
+
+/* make the timer file descriptor fire at the earliest wake time */
+static void timer_arm(void)
+{
+	struct itimerspec its = {0};
+
+	if (timer_count == 0 || timers[0]->wake_time == timer_armed)
+		return;
+
+	timer_armed = timers[0]->wake_time;
+	its.it_value.tv_sec = timer_armed / 1000000000;
+	its.it_value.tv_nsec = timer_armed % 1000000000;
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+		perror("timerfd_settime in timer_arm");
+		exit(1);
+	}
+}
+
+/* add a file descriptor owned by the event loop to the epoll instance */
+static int event_add(int fd, void *tag)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = tag;
+
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int event_start(void)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (epoll_fd == -1 || timer_fd == -1 || wake_fd == -1 ||
+	    event_add(timer_fd, &timer_tag) == -1 ||
+	    event_add(wake_fd, &wake_tag) == -1) {
+		event_stop();
+		return -1;
+	}
+
+	return 0;
+}
+
+void event_stop(void)
+{
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	if (timer_fd != -1)
+		close(timer_fd);
+	if (wake_fd != -1)
+		close(wake_fd);
+	epoll_fd = timer_fd = wake_fd = -1;
+
+	free(timers);
+	timers = NULL;
+	timer_count = timer_capacity = 0;
+	timer_armed = 0;
+	fd_waiters = 0;
+	last_poll = 0;
+}
+
+void event_notify(void)
+{
+	uint64_t one = 1;
+
+	if (write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		perror("write in event_notify");
+		exit(1);
+	}
+}
+
+int event_poll(int block)
+{
+	struct epoll_event events[EVENT_MAX];
+	uint64_t count;
+	int woken, timeout = 0;
+
+	woken = timer_expire() + offload_poll() + remote_poll();
+
+	if (block) {
+		if (woken > 0)
+			return woken;
+		/* nothing left which could wake a thread up */
+		if (timer_count == 0 && fd_waiters == 0 && offload_pending() == 0 &&
+		    remote_waiters() == 0)
+			return -1;
+	} else if (fd_waiters == 0 ||
+		   sched_now() - last_poll < EVENT_POLL_INTERVAL) {
+		return woken;
+	}
+	last_poll = sched_now();
+
+	do {
+		if (block) {
+			timer_arm();
+			/* other kernel threads only notify a sleeping loop */
+			timeout = remote_idle(1) ? 0 : -1;
+		}
+
+		int n = epoll_wait(epoll_fd, events, EVENT_MAX, timeout);
+		if (n == -1 && errno != EINTR) {
+			perror("epoll_wait in event_poll");
+			exit(1);
+		}
+		if (block)
+			remote_idle(0);
+
+		for (int i = 0; i < n; i++) {
+			void *tag = events[i].data.ptr;
+
+			if (tag == &timer_tag) {
+				/* the sleepers are woken up by timer_expire() */
+				if (read(timer_fd, &count, sizeof(count)) > 0)
+					timer_armed = 0;
+			} else if (tag == &wake_tag) {
+				/* another kernel thread has work for us */
+				if (read(wake_fd, &count, sizeof(count)) > 0)
+					woken += offload_poll();
+			} else {
+				struct TCB *tcb = tag;
+
+				tcb->fd_events = events[i].events;
+				fd_waiters--;
+				uthread_unblock(tcb);
+				woken++;
+			}
+		}
+
+		woken += timer_expire() + remote_poll();
+	} while (block && woken == 0);
+
+	return woken;
+}
+
+int uthread_sleep(unsigned long usec)
+{
+	struct TCB *tcb = uthread_current();
+
+	uthread_testcancel();
+
+	preempt_disable();
+
+	tcb->wake_time = event_clock() + (uint64_t)usec * 1000;
+	if (timer_push(tcb) == -1) {
+		preempt_enable();
+		return -1;
+	}
+
+	/* a thread with a deadline does not wait for the next tick to run */
+	if (tcb_deadline(tcb) != 0)
+		preempt_resched_at(tcb->wake_time);
+
+	/* woken up by timer_expire(), or by a cancellation */
+	uthread_block();
+
+	preempt_disable();
+	if (tcb->timer_index >= 0)
+		timer_remove(tcb);
+	preempt_enable();
+
+	uthread_testcancel();
+
+	return 0;
+}
+
+int uthread_wait_fd(int fd, unsigned int events)
+{
+	struct TCB *tcb = uthread_current();
+	struct epoll_event ev;
+
+	/* a single event wakes the thread up, then the fd is disabled */
+	ev.events = events | EPOLLONESHOT;
+	ev.data.ptr = tcb;
+
+	uthread_testcancel();
+
+	preempt_disable();
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		preempt_enable();
+		return -1;
+	}
+	fd_waiters++;
+	tcb->fd_events = 0;
+
+	/* woken up by event_poll(), or by a cancellation */
+	uthread_block();
+
+	preempt_disable();
+	/* no event was received, the thread is no longer a waiter */
+	if (tcb->fd_events == 0)
+		fd_waiters--;
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	preempt_enable();
+
+	uthread_testcancel();
+
+	return tcb->fd_events;
+}
@@ -0,0 +1,262 @@
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* A job submitted to an executor */
+struct exec_job {
+	uthread_async_func_t func;
+	void *arg;
+};
+
+struct uthread_exec {
+	int max_threads;
+	int max_pending;
+	/* threads running the jobs, parked on by uthread_exec_destroy() */
+	int live;
+	/* ring of the jobs waiting for a thread */
+	struct exec_job *pending;
+	int head;
+	int count;
+	/* changes each time a job leaves the ring, parked on by submitters */
+	int room_seq;
+	struct uthread_exec_stats stats;
+};
+
+/* A thread of an executor, running jobs until the ring is empty */
+struct exec_worker {
+	struct uthread_exec *exec;
+	struct exec_job job;
+};
+
+static int worker_entry(void);
+
+/* start a thread running @job, preemption must be disabled */
+static int worker_spawn(struct uthread_exec *exec, struct exec_job job)
+{
+	struct exec_worker *worker = malloc(sizeof(struct exec_worker));
+
+	/* malloc failed */
+	if (worker == NULL)
+		return -1;
+
+	worker->exec = exec;
+	worker->job = job;
+
+	/* workers serve every submitter, they do not belong to one of them */
+	if (uthread_spawn_orphan(worker_entry, worker) == NULL) {
+		free(worker);
+		return -1;
+	}
+	exec->live++;
+
+	return 0;
+}
+
+/* take the next job out of the ring, preemption must be disabled */
+static struct exec_job ring_pop(struct uthread_exec *exec)
+{
+	struct exec_job job = exec->pending[exec->head];
+
+	exec->head = (exec->head + 1) % exec->max_pending;
+	exec->count--;
+
+	/* a parked submitter can use the room */
+	exec->room_seq++;
+	park_wake(&exec->room_seq, 1);
+
+	return job;
+}
+
+/* cleanup handler of the workers, run however they exit */
+static void worker_exit(void *arg)
+{
+	struct exec_worker *worker = arg;
+	struct uthread_exec *exec = worker->exec;
+
+	free(worker);
+
+	preempt_disable();
+	exec->live--;
+
+	/* a job ended the thread early, another one takes over the ring */
+	if (exec->count > 0)
+		worker_spawn(exec, ring_pop(exec));
+
+	park_wake(&exec->live, INT_MAX);
+	preempt_enable();
+}
+
+static int worker_entry(void)
+{
+	struct exec_worker *worker = uthread_current()->arg;
+	struct uthread_exec *exec = worker->exec;
+	struct exec_job job = worker->job;
+	int cleanup = uthread_cleanup_push(worker_exit, worker) == 0;
+
+	/* the thread is reused for the jobs waiting in the ring */
+	while (1) {
+		job.func(job.arg);
+
+		preempt_disable();
+		exec->stats.completed++;
+		if (exec->count == 0)
+			break;
+		job = ring_pop(exec);
+		preempt_enable();
+	}
+	preempt_enable();
+
+	if (cleanup)
+		uthread_cleanup_pop(1);
+	else
+		worker_exit(worker);
+
+	return 0;
+}
+
+uthread_exec_t uthread_exec_create(int max_threads, int max_pending)
+{
+	if (max_threads <= 0 || max_pending < 0)
+		return NULL;
+
+	struct uthread_exec *exec = malloc(sizeof(struct uthread_exec));
+
+	/* malloc failed */
+	if (exec == NULL)
+		return NULL;
+
+	exec->pending = NULL;
+	if (max_pending > 0) {
+		exec->pending = malloc(max_pending * sizeof(struct exec_job));
+		if (exec->pending == NULL) {
+			free(exec);
+			return NULL;
+		}
+	}
+
+	exec->max_threads = max_threads;
+	exec->max_pending = max_pending;
+	exec->live = 0;
+	exec->head = 0;
+	exec->count = 0;
+	exec->room_seq = 0;
+	exec->stats = (struct uthread_exec_stats){0};
+
+	return exec;
+}
+
+/*
+ * start a job at once, or queue it, preemption must be disabled
+ *
+ * Return: 0 if the job was accepted, 1 if the executor is full, -1 in case of
+ * memory allocation failure
+ */
+static int exec_accept(struct uthread_exec *exec, struct exec_job job)
+{
+	if (exec->live < exec->max_threads)
+		return worker_spawn(exec, job);
+
+	if (exec->count == exec->max_pending)
+		return 1;
+
+	exec->pending[(exec->head + exec->count) % exec->max_pending] = job;
+	exec->count++;
+	if (exec->count > exec->stats.pending_peak)
+		exec->stats.pending_peak = exec->count;
+
+	return 0;
+}
+
+int uthread_exec_submit(uthread_exec_t exec, uthread_async_func_t func,
+			void *arg)
+{
+	struct exec_job job = { func, arg };
+	int ret;
+
+	if (exec == NULL || func == NULL)
+		return -1;
+
+	uthread_testcancel();
+
+	preempt_disable();
+
+	/* wait for a job to leave the ring */
+	while ((ret = exec_accept(exec, job)) == 1) {
+		if (park_wait(&exec->room_seq, exec->room_seq) == 1) {
+			/* the room may have been meant for us, pass it on */
+			preempt_disable();
+			park_wake(&exec->room_seq, 1);
+			preempt_enable();
+			uthread_testcancel();
+		}
+		preempt_disable();
+	}
+
+	if (ret == 0)
+		exec->stats.submitted++;
+	preempt_enable();
+
+	return ret;
+}
+
+int uthread_exec_try_submit(uthread_exec_t exec, uthread_async_func_t func,
+			    void *arg)
+{
+	struct exec_job job = { func, arg };
+	int ret;
+
+	if (exec == NULL || func == NULL)
+		return -1;
+
+	preempt_disable();
+
+	ret = exec_accept(exec, job);
+	if (ret == 0)
+		exec->stats.submitted++;
+	else if (ret == 1)
+		exec->stats.rejected++;
+
+	preempt_enable();
+
+	return ret == 0 ? 0 : -1;
+}
+
+int uthread_exec_get_stats(uthread_exec_t exec,
+			   struct uthread_exec_stats *stats)
+{
+	if (exec == NULL || stats == NULL)
+		return -1;
+
+	preempt_disable();
+	*stats = exec->stats;
+	stats->running = exec->live;
+	stats->pending = exec->count;
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_exec_destroy(uthread_exec_t exec)
+{
+	if (exec == NULL)
+		return -1;
+
+	uthread_testcancel();
+
+	/* the last thread leaves once the ring is empty */
+	preempt_disable();
+	while (exec->live > 0) {
+		if (park_wait(&exec->live, exec->live) == 1)
+			uthread_testcancel();
+		preempt_disable();
+	}
+	preempt_enable();
+
+	free(exec->pending);
+	free(exec);
+
+	return 0;
+}
@@ -0,0 +1,279 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* A thread waiting for one or several futures, parked on @remaining */
+struct future_wait {
+	/* number of completions still needed before waking the thread */
+	int remaining;
+	/* index of the first future which completed */
+	int first;
+};
+
+/* Link between a future and a waiting thread, owned by the waiting thread */
+struct future_link {
+	struct future_wait *wait;
+	int index;
+	struct future_link *prev;
+	struct future_link *next;
+};
+
+struct uthread_future {
+	uthread_async_func_t func;
+	void *arg;
+	void *result;
+	int done;
+	/* destroyed before completion, freed by its thread when done */
+	int orphan;
+	/* threads waiting for this future */
+	struct future_link *waiters;
+};
+
+/* add a link at the head of the waiter list of @future */
+static void link_add(struct uthread_future *future, struct future_link *link)
+{
+	link->prev = NULL;
+	link->next = future->waiters;
+	if (future->waiters != NULL)
+		future->waiters->prev = link;
+	future->waiters = link;
+}
+
+/* remove a link from the waiter list of @future */
+static void link_remove(struct uthread_future *future, struct future_link *link)
+{
+	if (link->prev == NULL)
+		future->waiters = link->next;
+	else
+		link->prev->next = link->next;
+	if (link->next != NULL)
+		link->next->prev = link->prev;
+}
+
+/* wake up the threads waiting for @future, preemption must be disabled */
+static void future_complete(struct uthread_future *future, void *result)
+{
+	struct future_link *link = future->waiters;
+
+	future->result = result;
+	future->done = 1;
+	future->waiters = NULL;
+
+	while (link != NULL) {
+		struct future_link *next = link->next;
+		struct future_wait *wait = link->wait;
+
+		/* the link is now detached from the future */
+		link->wait = NULL;
+
+		if (wait->first == -1)
+			wait->first = link->index;
+		if (--wait->remaining == 0)
+			park_wake(&wait->remaining, 1);
+
+		link = next;
+	}
+}
+
+/* complete @future, or free it if nobody can wait for it anymore */
+static void future_finish(struct uthread_future *future, void *result)
+{
+	/* waiters must not run before they are all woken */
+	preempt_disable();
+	if (future->orphan)
+		free(future);
+	else
+		future_complete(future, result);
+	preempt_enable();
+}
+
+/* cleanup handler of a cancelled future, completed without a result */
+static void future_cancel(void *arg)
+{
+	future_finish(arg, NULL);
+}
+
+/* entry point of the threads created by uthread_async() */
+static int future_entry(void)
+{
+	struct uthread_future *future = uthread_current()->arg;
+
+	/* the waiters must not wait forever if this thread is cancelled */
+	if (uthread_cleanup_push(future_cancel, future) == -1) {
+		future_finish(future, future->func(future->arg));
+		return 0;
+	}
+
+	void *result = future->func(future->arg);
+
+	uthread_cleanup_pop(0);
+	future_finish(future, result);
+
+	return 0;
+}
+
+uthread_future_t uthread_async(uthread_async_func_t func, void *arg)
+{
+	if (func == NULL)
+		return NULL;
+
+	struct uthread_future *future = malloc(sizeof(struct uthread_future));
+
+	/* malloc failed */
+	if (future == NULL)
+		return NULL;
+
+	future->func = func;
+	future->arg = arg;
+	future->result = NULL;
+	future->done = 0;
+	future->orphan = 0;
+	future->waiters = NULL;
+
+	if (uthread_spawn(future_entry, future, 1) == NULL) {
+		free(future);
+		return NULL;
+	}
+
+	return future;
+}
+
+/*
+ * wait for @n futures, until @needed of them completed
+ *
+ * Return: -1 in case of memory allocation error, otherwise the index of the
+ * first future which completed, or of a completed future if enough of them
+ * were already completed.
+ */
+static int future_wait(uthread_future_t *futures, int n, int needed)
+{
+	struct future_wait wait;
+	struct future_link *links;
+	int i;
+
+	uthread_testcancel();
+
+	/* nothing can complete while we look at the futures */
+	preempt_disable();
+
+	wait.remaining = needed;
+	wait.first = -1;
+	for (i = 0; i < n; i++) {
+		if (futures[i]->done) {
+			if (wait.first == -1)
+				wait.first = i;
+			wait.remaining--;
+		}
+	}
+
+	if (wait.remaining <= 0) {
+		preempt_enable();
+		return wait.first;
+	}
+	/* completions already seen do not count as the first to wake us */
+	wait.first = -1;
+
+	links = malloc(n * sizeof(struct future_link));
+	if (links == NULL) {
+		preempt_enable();
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		links[i].wait = NULL;
+		if (futures[i]->done)
+			continue;
+		links[i].wait = &wait;
+		links[i].index = i;
+		link_add(futures[i], &links[i]);
+	}
+
+	/* sleep until the completion which brings remaining to zero */
+	while (wait.remaining > 0) {
+		/* cancelled, the links are removed all the same */
+		if (park_wait(&wait.remaining, wait.remaining) == 1)
+			break;
+		preempt_disable();
+	}
+
+	/* drop the links of the futures which did not complete */
+	preempt_disable();
+	for (i = 0; i < n; i++) {
+		if (links[i].wait != NULL)
+			link_remove(futures[i], &links[i]);
+	}
+	preempt_enable();
+
+	free(links);
+
+	uthread_testcancel();
+
+	return wait.first;
+}
+
+/* check that all the futures of an array are valid */
+static int future_check(uthread_future_t *futures, int n)
+{
+	if (futures == NULL || n <= 0)
+		return -1;
+
+	for (int i = 0; i < n; i++) {
+		if (futures[i] == NULL)
+			return -1;
+	}
+
+	return 0;
+}
+
+int uthread_future_get(uthread_future_t future, void **result)
+{
+	if (future == NULL)
+		return -1;
+
+	if (future_wait(&future, 1, 1) == -1)
+		return -1;
+
+	if (result != NULL)
+		*result = future->result;
+
+	return 0;
+}
+
+int uthread_future_destroy(uthread_future_t future)
+{
+	if (future == NULL)
+		return -1;
+
+	preempt_disable();
+	if (future->done)
+		free(future);
+	else
+		future->orphan = 1;
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_when_all(uthread_future_t *futures, int n)
+{
+	if (n == 0)
+		return 0;
+
+	if (future_check(futures, n) == -1)
+		return -1;
+
+	if (future_wait(futures, n, n) == -1)
+		return -1;
+
+	return 0;
+}
+
+int uthread_when_any(uthread_future_t *futures, int n)
+{
+	if (future_check(futures, n) == -1)
+		return -1;
+
+	return future_wait(futures, n, 1);
+}
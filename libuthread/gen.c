@@ -0,0 +1,119 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "uthread.h"
+
+struct uthread_gen {
+	uthread_gen_func_t func;
+	void *arg;
+	/*
+	 * the generator and its consumer run in the same thread, with the same
+	 * signal mask: they switch registers and stacks only
+	 */
+	uthread_stack_ctx_t gen_ctx;
+	uthread_stack_ctx_t caller_ctx;
+	void *stack;
+	/* value passed in the current direction */
+	void *value;
+	int running;
+	int done;
+};
+
+/* entry point of the generator contexts */
+static void gen_entry(void *arg)
+{
+	struct uthread_gen *gen = arg;
+
+	gen->value = gen->func(gen, gen->arg);
+	gen->done = 1;
+
+	/* never resumed again, the consumer frees the stack */
+	uthread_stack_ctx_switch(&gen->gen_ctx, &gen->caller_ctx);
+}
+
+uthread_gen_t uthread_gen_create(uthread_gen_func_t func, void *arg)
+{
+	if (func == NULL)
+		return NULL;
+
+	struct uthread_gen *gen = malloc(sizeof(struct uthread_gen));
+
+	/* malloc failed */
+	if (gen == NULL)
+		return NULL;
+
+	preempt_disable();
+	gen->stack = uthread_ctx_alloc_stack();
+	preempt_enable();
+
+	if (gen->stack == NULL ||
+	    uthread_stack_ctx_make(&gen->gen_ctx, gen->stack, gen_entry,
+				   gen) == -1) {
+		preempt_disable();
+		uthread_ctx_destroy_stack(gen->stack);
+		preempt_enable();
+		free(gen);
+		return NULL;
+	}
+
+	gen->func = func;
+	gen->arg = arg;
+	gen->value = NULL;
+	gen->running = 0;
+	gen->done = 0;
+
+	return gen;
+}
+
+int uthread_gen_next(uthread_gen_t gen, void *in, void **out)
+{
+	/* a generator cannot resume itself nor a finished generator */
+	if (gen == NULL || gen->running || gen->done)
+		return -1;
+
+	gen->value = in;
+	gen->running = 1;
+
+	/*
+	 * The generator runs on behalf of the current thread: if it is
+	 * preempted, the whole thread is, and nothing else can resume it.
+	 */
+	uthread_stack_ctx_switch(&gen->caller_ctx, &gen->gen_ctx);
+
+	gen->running = 0;
+	if (out != NULL)
+		*out = gen->value;
+
+	if (gen->done) {
+		/* the stack can go back to the pool as soon as possible */
+		preempt_disable();
+		uthread_ctx_destroy_stack(gen->stack);
+		preempt_enable();
+		gen->stack = NULL;
+		return 0;
+	}
+
+	return 1;
+}
+
+void *uthread_gen_yield(uthread_gen_t gen, void *value)
+{
+	gen->value = value;
+	uthread_stack_ctx_switch(&gen->gen_ctx, &gen->caller_ctx);
+
+	return gen->value;
+}
+
+int uthread_gen_destroy(uthread_gen_t gen)
+{
+	if (gen == NULL || gen->running)
+		return -1;
+
+	preempt_disable();
+	uthread_ctx_destroy_stack(gen->stack);
+	preempt_enable();
+	free(gen);
+
+	return 0;
+}
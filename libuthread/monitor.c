@@ -0,0 +1,130 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "monitor.h"
+#include "private.h"
+#include "uthread.h"
+
+/* Number of thread entries in the segment */
+#define MONITOR_CAPACITY 4096
+
+/* Maximum length of the name of the segment */
+#define MONITOR_NAME 32
+
+static struct uthread_monitor *segment;
+static size_t segment_size;
+static char segment_name[MONITOR_NAME];
+static uint64_t period;
+static uint64_t last_update;
+
+/* fill the entry of a thread, the segment is being written */
+static void monitor_thread(struct TCB *tcb, uthread_handle_t handle, void *arg)
+{
+	struct uthread_monitor *copy = arg;
+	struct uthread_monitor_thread *entry;
+
+	copy->threads++;
+	copy->preemptions += tcb->preemptions;
+	if (tcb->state == Ready)
+		copy->ready++;
+
+	if (copy->published == copy->capacity)
+		return;
+
+	entry = &copy->thread[copy->published++];
+	entry->handle = handle;
+	entry->state = tcb->state;
+	entry->deadline = tcb_deadline(tcb) != 0;
+	entry->run_time = tcb->run_time;
+	entry->preemptions = tcb->preemptions;
+}
+
+/* rewrite the segment, inside a write section of the sequence counter */
+static void monitor_update(uint64_t now)
+{
+	uint32_t seq = segment->seq;
+
+	__atomic_store_n(&segment->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	segment->time = now;
+	segment->updates++;
+	segment->threads = 0;
+	segment->ready = 0;
+	segment->preemptions = 0;
+	segment->published = 0;
+	uthread_walk(monitor_thread, segment);
+
+	__atomic_store_n(&segment->seq, seq + 2, __ATOMIC_RELEASE);
+
+	last_update = now;
+}
+
+void monitor_poll(void)
+{
+	/* the scheduler read the clock when it charged the last thread */
+	if (segment != NULL && sched_now() - last_update >= period)
+		monitor_update(sched_now());
+}
+
+int uthread_monitor_start(unsigned int period_ms)
+{
+	int fd;
+
+	if (period_ms == 0 || segment != NULL || uthread_current() == NULL)
+		return -1;
+
+	snprintf(segment_name, MONITOR_NAME, UTHREAD_MONITOR_NAME, getpid());
+	segment_size = sizeof(struct uthread_monitor) +
+		MONITOR_CAPACITY * sizeof(struct uthread_monitor_thread);
+
+	fd = shm_open(segment_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return -1;
+
+	if (ftruncate(fd, segment_size) == -1) {
+		close(fd);
+		shm_unlink(segment_name);
+		return -1;
+	}
+
+	segment = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		       fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED) {
+		segment = NULL;
+		shm_unlink(segment_name);
+		return -1;
+	}
+
+	segment->magic = UTHREAD_MONITOR_MAGIC;
+	segment->version = UTHREAD_MONITOR_VERSION;
+	segment->period_ms = period_ms;
+	segment->capacity = MONITOR_CAPACITY;
+	period = (uint64_t)period_ms * 1000000;
+
+	/* readers attaching now find a first update */
+	preempt_disable();
+	monitor_update(sched_now());
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_monitor_stop(void)
+{
+	if (segment == NULL)
+		return -1;
+
+	/* readers which mapped the segment keep the last update */
+	shm_unlink(segment_name);
+	munmap(segment, segment_size);
+	segment = NULL;
+
+	return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef _MONITOR_H
+#define _MONITOR_H
+
+#include <stdint.h>
+
+/*
+ * Layout of the shared memory segment published by uthread_monitor_start()
+ *
+ * The segment is a POSIX shared memory object named after the process ID, see
+ * UTHREAD_MONITOR_NAME. Other processes can map it read-only at any time: it
+ * starts with a struct uthread_monitor, followed by @capacity entries of
+ * struct uthread_monitor_thread, @published of which are valid.
+ *
+ * The scheduler rewrites the whole segment at each update, between two
+ * increments of @seq: @seq is odd while the segment is being written. A reader
+ * copies the segment and keeps its copy only if @seq was even and did not
+ * change meanwhile; otherwise it tries again.
+ */
+
+/* Name of the segment of process @pid, a printf() format */
+#define UTHREAD_MONITOR_NAME "/uthread.%d"
+
+/* "utop", in the first bytes of the segment */
+#define UTHREAD_MONITOR_MAGIC 0x706f7475
+#define UTHREAD_MONITOR_VERSION 1
+
+/*
+ * struct uthread_monitor_thread - State of a thread in the segment
+ * @handle: Handle of the thread, see uthread_handle_t
+ * @state: UTHREAD_MONITOR_RUNNING, _READY, _BLOCKED or _ZOMBIE
+ * @deadline: Whether the thread is scheduled by a deadline, its own or one
+ * inherited through a mutex
+ * @run_time: CPU time used by the thread, in nanoseconds
+ * @preemptions: Number of times the thread was preempted by the timer
+ */
+struct uthread_monitor_thread {
+	uint64_t handle;
+	uint32_t state;
+	uint32_t deadline;
+	uint64_t run_time;
+	uint64_t preemptions;
+};
+
+#define UTHREAD_MONITOR_RUNNING 0
+#define UTHREAD_MONITOR_READY 1
+#define UTHREAD_MONITOR_BLOCKED 2
+#define UTHREAD_MONITOR_ZOMBIE 3
+
+/*
+ * struct uthread_monitor - Header of the segment
+ * @magic: UTHREAD_MONITOR_MAGIC
+ * @version: UTHREAD_MONITOR_VERSION
+ * @seq: Sequence counter, odd while the segment is being written
+ * @period_ms: Time between two updates, in milliseconds
+ * @time: CLOCK_MONOTONIC time of the last update, in nanoseconds
+ * @updates: Number of updates so far
+ * @threads: Number of threads, including the main thread and zombies
+ * @ready: Number of threads ready to run
+ * @preemptions: Number of preemptions by the timer, in total
+ * @capacity: Number of thread entries in the segment
+ * @published: Number of valid thread entries, at most @capacity
+ */
+struct uthread_monitor {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;
+	uint32_t period_ms;
+	uint64_t time;
+	uint64_t updates;
+	uint32_t threads;
+	uint32_t ready;
+	uint64_t preemptions;
+	uint32_t capacity;
+	uint32_t published;
+	struct uthread_monitor_thread thread[];
+};
+
+#endif /* _MONITOR_H */
@@ -0,0 +1,290 @@
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cqueue.h"
+#include "private.h"
+#include "queue.h"
+#include "uthread.h"
+
+/* Default number of helper threads and of waiting jobs */
+#define OFFLOAD_THREADS 4
+#define OFFLOAD_DEPTH 64
+
+/* Maximum number of completed jobs collected at once */
+#define OFFLOAD_BATCH 16
+
+/*
+ * A call made on behalf of a blocked thread. The job of a cancelled thread has
+ * no @tcb anymore and is freed once collected.
+ */
+struct offload_job {
+	uthread_async_func_t func;
+	void *arg;
+	void *result;
+	struct TCB *tcb;
+	int done;
+};
+
+static int pool_threads = OFFLOAD_THREADS;
+static int pool_depth = OFFLOAD_DEPTH;
+static int pool_started;
+/* maximum number of jobs submitted and not collected yet */
+static int pool_capacity;
+static pthread_t *helpers;
+
+/* jobs waiting for a helper, counted by the semaphore */
+static cqueue_t submit_queue;
+static sem_t submit_sem;
+/* jobs completed by a helper, collected by the scheduler */
+static cqueue_t done_queue;
+static atomic_int pool_shutdown;
+
+/* threads waiting for room in the submit queue */
+static queue_t full_waiters;
+/* number of jobs submitted and not collected yet */
+static int pending;
+
+static void *helper(void *arg)
+{
+	struct offload_job *job;
+
+	(void)arg;
+
+	while (1) {
+		if (sem_wait(&submit_sem) != 0) {
+			if (errno == EINTR)
+				continue;
+			perror("sem_wait in helper");
+			exit(1);
+		}
+		if (atomic_load(&pool_shutdown))
+			break;
+
+		/* the semaphore counts the jobs, there is one for us */
+		if (cqueue_try_dequeue(submit_queue, (void**)&job) == -1)
+			continue;
+
+		job->result = job->func(job->arg);
+
+		/* the done queue can hold every job in flight, see pending */
+		if (cqueue_try_enqueue(done_queue, job) == -1) {
+			fprintf(stderr, "helper: done queue full\n");
+			exit(1);
+		}
+		event_notify();
+	}
+
+	return NULL;
+}
+
+static int offload_start(void)
+{
+	sigset_t all, old;
+	int i;
+
+	submit_queue = cqueue_create(pool_depth);
+	/*
+	 * submissions are bounded by the jobs not collected yet rather than by
+	 * the room in the submit queue, which a helper frees as soon as it takes
+	 * a job: all of them fit in either queue at once
+	 */
+	pool_capacity = cqueue_capacity(submit_queue);
+	done_queue = cqueue_create(pool_capacity > 0 ? pool_capacity : 1);
+	full_waiters = queue_create_backend(QUEUE_RING);
+	helpers = malloc(pool_threads * sizeof(pthread_t));
+
+	if (submit_queue == NULL || done_queue == NULL || full_waiters == NULL ||
+	    helpers == NULL || sem_init(&submit_sem, 0, 0) != 0) {
+		cqueue_destroy(submit_queue);
+		cqueue_destroy(done_queue);
+		queue_destroy(full_waiters);
+		free(helpers);
+		return -1;
+	}
+
+	/* helpers must never receive the signals of the scheduler */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	atomic_store(&pool_shutdown, 0);
+	for (i = 0; i < pool_threads; i++) {
+		if (pthread_create(&helpers[i], NULL, helper, NULL) != 0) {
+			perror("pthread_create in offload_start");
+			exit(1);
+		}
+		affinity_pin_helper(helpers[i], i);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	pool_started = 1;
+
+	return 0;
+}
+
+void offload_stop(void)
+{
+	struct offload_job *job;
+	int i;
+
+	if (!pool_started)
+		return;
+
+	atomic_store(&pool_shutdown, 1);
+	for (i = 0; i < pool_threads; i++)
+		sem_post(&submit_sem);
+	for (i = 0; i < pool_threads; i++)
+		pthread_join(helpers[i], NULL);
+
+	/* only the jobs of cancelled threads can be left */
+	while (cqueue_try_dequeue(submit_queue, (void**)&job) == 0)
+		free(job);
+	while (cqueue_try_dequeue(done_queue, (void**)&job) == 0)
+		free(job);
+	pending = 0;
+
+	sem_destroy(&submit_sem);
+	cqueue_destroy(submit_queue);
+	cqueue_destroy(done_queue);
+	queue_destroy(full_waiters);
+	free(helpers);
+	pool_started = 0;
+}
+
+int offload_pending(void)
+{
+	return pending;
+}
+
+int offload_poll(void)
+{
+	struct offload_job *jobs[OFFLOAD_BATCH];
+	struct TCB *tcb;
+	int n, woken = 0;
+
+	if (pending == 0)
+		return 0;
+
+	while ((n = cqueue_try_dequeue_batch(done_queue, (void**)jobs,
+					     OFFLOAD_BATCH)) > 0) {
+		for (int i = 0; i < n; i++) {
+			if (jobs[i]->tcb == NULL) {
+				free(jobs[i]);
+			} else {
+				jobs[i]->done = 1;
+				uthread_unblock(jobs[i]->tcb);
+				woken++;
+			}
+			pending--;
+
+			/* a thread waiting for room can try again */
+			if (queue_dequeue(full_waiters, (void**)&tcb) == 0) {
+				uthread_unblock(tcb);
+				woken++;
+			}
+		}
+	}
+
+	return woken;
+}
+
+int uthread_offload_config(int threads, int depth)
+{
+	if (threads <= 0 || depth <= 0 || pool_started)
+		return -1;
+
+	pool_threads = threads;
+	pool_depth = depth;
+
+	return 0;
+}
+
+/* stop waiting for room in the submit queue, preemption must be disabled */
+static void full_leave(struct TCB *tcb)
+{
+	/* already dequeued by offload_poll(), hand the room to another thread */
+	if (queue_delete(full_waiters, tcb) == -1 &&
+	    queue_dequeue(full_waiters, (void**)&tcb) == 0)
+		uthread_unblock(tcb);
+}
+
+int uthread_offload(uthread_async_func_t func, void *arg, void **result)
+{
+	struct offload_job *job;
+	struct TCB *tcb = uthread_current();
+
+	if (func == NULL)
+		return -1;
+
+	uthread_testcancel();
+
+	/* the job outlives the thread if it is cancelled */
+	job = malloc(sizeof(struct offload_job));
+	if (job == NULL)
+		return -1;
+
+	job->func = func;
+	job->arg = arg;
+	job->result = NULL;
+	job->tcb = tcb;
+	job->done = 0;
+
+	preempt_disable();
+
+	if (!pool_started && offload_start() == -1) {
+		preempt_enable();
+		free(job);
+		return -1;
+	}
+
+	/* the pool is full, wait until a completed job is collected */
+	while (pending == pool_capacity) {
+		queue_enqueue(full_waiters, tcb);
+		uthread_block();
+		preempt_disable();
+
+		/* a thread running its cleanup handlers is not cancelled again */
+		if (tcb->cancel_pending && !tcb->exiting) {
+			full_leave(tcb);
+			preempt_enable();
+			free(job);
+			uthread_testcancel();
+			preempt_disable();
+		}
+	}
+	/* the submit queue holds at most the @pending jobs */
+	if (cqueue_try_enqueue(submit_queue, job) == -1) {
+		fprintf(stderr, "uthread_offload: submit queue full\n");
+		exit(1);
+	}
+	pending++;
+	sem_post(&submit_sem);
+
+	/* woken up by offload_poll() once a helper ran the job */
+	uthread_block();
+
+	preempt_disable();
+	while (!job->done) {
+		if (tcb->cancel_pending && !tcb->exiting) {
+			/* cancelled while the job runs, offload_poll() will free it */
+			job->tcb = NULL;
+			preempt_enable();
+			uthread_testcancel();
+		}
+		uthread_block();
+		preempt_disable();
+	}
+	preempt_enable();
+
+	if (result != NULL)
+		*result = job->result;
+	free(job);
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Maximum number of threads made ready at once by park_wake() */
+#define PARK_BATCH 64
+
+/* Number of buckets of the wait table */
+#define PARK_BUCKET_BITS 8
+#define PARK_BUCKETS (1 << PARK_BUCKET_BITS)
+
+/* A thread parked on an address, owned by the parked thread */
+struct park_waiter {
+	const int *addr;
+	struct TCB *tcb;
+	/* set by park_wake() once the waiter is out of the bucket */
+	int woken;
+	struct park_waiter *prev;
+	struct park_waiter *next;
+};
+
+/*
+ * Waiters of all the addresses hashed to the same bucket, in arrival order.
+ * The lock is always taken with preemption disabled, so a thread never spins
+ * on a lock held by a thread of the same scheduler.
+ */
+struct park_bucket {
+	atomic_flag lock;
+	struct park_waiter *head;
+	struct park_waiter *tail;
+};
+
+static struct park_bucket buckets[PARK_BUCKETS];
+
+static struct park_bucket *bucket_of(const int *addr)
+{
+	/* Fibonacci hashing, the low bits of an address are mostly zeros */
+	uint64_t hash = (uintptr_t)addr * 0x9e3779b97f4a7c15ULL;
+
+	return &buckets[hash >> (64 - PARK_BUCKET_BITS)];
+}
+
+static void bucket_lock(struct park_bucket *bucket)
+{
+	while (atomic_flag_test_and_set_explicit(&bucket->lock,
+						 memory_order_acquire))
+		;
+}
+
+static void bucket_unlock(struct park_bucket *bucket)
+{
+	atomic_flag_clear_explicit(&bucket->lock, memory_order_release);
+}
+
+static void bucket_remove(struct park_bucket *bucket, struct park_waiter *w)
+{
+	if (w->prev == NULL)
+		bucket->head = w->next;
+	else
+		w->prev->next = w->next;
+	if (w->next == NULL)
+		bucket->tail = w->prev;
+	else
+		w->next->prev = w->prev;
+}
+
+int park_wait(const int *addr, int expected)
+{
+	struct park_bucket *bucket = bucket_of(addr);
+	struct park_waiter w;
+
+	bucket_lock(bucket);
+
+	/* the value changed since the caller looked at it, do not sleep */
+	if (__atomic_load_n(addr, __ATOMIC_ACQUIRE) != expected) {
+		bucket_unlock(bucket);
+		preempt_enable();
+		return -1;
+	}
+
+	w.addr = addr;
+	w.tcb = uthread_current();
+	w.woken = 0;
+	w.next = NULL;
+	w.prev = bucket->tail;
+	if (bucket->tail == NULL)
+		bucket->head = &w;
+	else
+		bucket->tail->next = &w;
+	bucket->tail = &w;
+
+	bucket_unlock(bucket);
+
+	/* woken up by park_wake(), or by a cancellation */
+	uthread_block();
+
+	preempt_disable();
+	bucket_lock(bucket);
+	if (!w.woken)
+		bucket_remove(bucket, &w);
+	bucket_unlock(bucket);
+	preempt_enable();
+
+	return w.woken ? 0 : 1;
+}
+
+int park_wake(const int *addr, int n)
+{
+	struct park_bucket *bucket = bucket_of(addr);
+	struct park_waiter *w, *next;
+	struct TCB *batch[PARK_BATCH];
+	int woken = 0, count = 0;
+
+	bucket_lock(bucket);
+
+	for (w = bucket->head; w != NULL && woken < n; w = next) {
+		next = w->next;
+		if (w->addr != addr)
+			continue;
+
+		bucket_remove(bucket, w);
+		w->woken = 1;
+		woken++;
+
+		/* a single thread runs next, several join the ready queue */
+		if (n == 1) {
+			uthread_unblock(w->tcb);
+			continue;
+		}
+
+		batch[count++] = w->tcb;
+		if (count == PARK_BATCH) {
+			uthread_unblock_batch(batch, count);
+			count = 0;
+		}
+	}
+	uthread_unblock_batch(batch, count);
+
+	bucket_unlock(bucket);
+
+	return woken;
+}
+
+int uthread_park(const int *addr, int expected)
+{
+	int ret;
+
+	if (addr == NULL)
+		return -1;
+
+	uthread_testcancel();
+
+	preempt_disable();
+	ret = park_wait(addr, expected);
+
+	uthread_testcancel();
+
+	return ret == -1 ? -1 : 0;
+}
+
+int uthread_unpark(const int *addr, int n)
+{
+	int woken;
+
+	if (addr == NULL || n <= 0)
+		return -1;
+
+	preempt_disable();
+	woken = park_wake(addr, n);
+	preempt_enable();
+
+	return woken;
+}
@@ -1,10 +1,17 @@
+/* the cooperative-only build has no preemption, see private.h */
+#ifndef UTHREAD_COOP
+
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "private.h"
 #include "uthread.h"
@@ -20,13 +27,31 @@
  */
 #define HZ_MICROSEC 1000000 / HZ 
 
+/* not named by the C library before glibc 2.41 */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* whether the timer is running */
+static bool preempt_active;
+
+/* kernel thread running the scheduler, the only one to preempt */
+static pid_t preempt_tid;
+
+/* one-shot timer preempting the running thread at a given time */
+static timer_t resched_timer;
+static bool resched_created;
+/* time the one-shot timer is armed for, 0 if disarmed */
+static uint64_t resched_armed;
+
 /* 
  * sig_handler - signal handler to ask a thread to yield
  * 
  * This function shall never return. */
 void sig_handler()
 {
-	uthread_yield();
+	uthread_current()->preemptions++;
+	uthread_resched();
 }
 
 void preempt_start(void)
@@ -53,6 +78,9 @@ void preempt_start(void)
 		perror("setitimer in preempt_start");
 		exit(1);
 	}
+
+	preempt_tid = syscall(SYS_gettid);
+	preempt_active = true;
 }
 
 void preempt_stop(void)
@@ -73,6 +101,29 @@ void preempt_stop(void)
 		perror("sigaction in preempt_stop");
 		exit(1);
 	}
+
+	if (resched_created) {
+		timer_delete(resched_timer);
+		resched_created = false;
+		resched_armed = 0;
+	}
+
+	preempt_active = false;
+}
+
+void preempt_resched(void)
+{
+	if (!preempt_active)
+		return;
+
+	/*
+	 * Same signal as the timer: delivered as soon as preemption is enabled
+	 * again, it makes the running thread yield without waiting for a tick
+	 */
+	if (pthread_kill(pthread_self(), SIGVTALRM) != 0) {
+		perror("pthread_kill in preempt_resched");
+		exit(1);
+	}
 }
 
 void preempt_enable(void)
@@ -109,3 +160,43 @@ void preempt_disable(void)
 	}
 }
 
+
+void preempt_resched_at(uint64_t when)
+{
+	struct sigevent sev;
+	struct itimerspec its = {0};
+
+	if (!preempt_active)
+		return;
+
+	/* an earlier preemption is already on its way */
+	if (resched_armed != 0 && resched_armed <= when &&
+	    resched_armed > event_clock())
+		return;
+
+	if (!resched_created) {
+		/*
+		 * not to the process, where the offload helpers or a thread
+		 * submitting remote jobs could receive the signal
+		 */
+		sev.sigev_notify = SIGEV_THREAD_ID;
+		sev.sigev_notify_thread_id = preempt_tid;
+		sev.sigev_signo = SIGVTALRM;
+		sev.sigev_value.sival_ptr = NULL;
+		if (timer_create(CLOCK_MONOTONIC, &sev, &resched_timer) != 0) {
+			perror("timer_create in preempt_resched_at");
+			exit(1);
+		}
+		resched_created = true;
+	}
+
+	resched_armed = when;
+	its.it_value.tv_sec = when / 1000000000;
+	its.it_value.tv_nsec = when % 1000000000;
+	if (timer_settime(resched_timer, TIMER_ABSTIME, &its, NULL) != 0) {
+		perror("timer_settime in preempt_resched_at");
+		exit(1);
+	}
+}
+
+#endif /* UTHREAD_COOP */
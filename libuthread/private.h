@@ -10,10 +10,29 @@
 /**
  * Private context API
  */
+#include <pthread.h>
+#include <stdint.h>
 #include <ucontext.h>
 
 #include "uthread.h"
 
+/*
+ * uthread_stack_ctx_t - Register-only execution context
+ *
+ * A context switched without its signal mask, for code which runs on behalf of
+ * the same thread on another stack, like a generator, and for every thread
+ * when there is no preemption. On x86-64, only the callee-saved registers are
+ * saved, on the stack being left, and the context is the stack pointer.
+ * Elsewhere it falls back to a ucontext.
+ */
+#if defined(__x86_64__)
+typedef struct {
+	void *sp;
+} uthread_stack_ctx_t;
+#else
+typedef ucontext_t uthread_stack_ctx_t;
+#endif
+
 /*
  * uthread_ctx_t - User-level thread context
  *
@@ -23,8 +42,18 @@
  * Such a context is initialized for the first time when creating a thread with
  * uthread_ctx_init(). Once initialized, it can be switched to with
  * uthread_ctx_switch().
+ *
+ * Without preemption (UTHREAD_COOP), no signal mask needs to be saved and
+ * restored: a thread context is a register-only context.
  */
+#ifdef UTHREAD_COOP
+typedef uthread_stack_ctx_t uthread_ctx_t;
+#else
 typedef ucontext_t uthread_ctx_t;
+#endif
+
+/* Size of the stack for a thread (in bytes) */
+#define UTHREAD_STACK_SIZE 32768
 
 /*
  * uthread_ctx_switch - Switch between two execution contexts
@@ -37,6 +66,9 @@ void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next);
 /*
  * uthread_ctx_alloc_stack - Allocate stack segment
  *
+ * Stacks are taken from a pool of previously deallocated stacks when possible.
+ * Must be called with preemption disabled.
+ *
  * Return: Pointer to the top of a valid stack segment, or NULL in case of
  * failure
  */
@@ -44,10 +76,18 @@ void *uthread_ctx_alloc_stack(void);
 
 /*
  * uthread_ctx_destroy_stack - Deallocate stack segment
- * @top_of_stack: Address of stack to deallocate
+ * @top_of_stack: Address of stack to deallocate, or NULL
+ *
+ * The stack is put back into the pool, unless the pool is full. Must be called
+ * with preemption disabled.
  */
 void uthread_ctx_destroy_stack(void *top_of_stack);
 
+/*
+ * uthread_ctx_release_stacks - Free the stacks kept in the pool
+ */
+void uthread_ctx_release_stacks(void);
+
 /*
  * uthread_ctx_init - Initialize a thread's execution context
  * @uctx: Pointer to thread context to initialize
@@ -60,10 +100,265 @@ void uthread_ctx_destroy_stack(void *top_of_stack);
 int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 					 uthread_func_t func);
 
+/*
+ * uthread_stack_ctx_make - Initialize a register-only execution context
+ * @sctx: Pointer to the context to initialize
+ * @top_of_stack: Pointer to the top of a valid stack segment, as allocated by
+ *	uthread_ctx_alloc_stack()
+ * @entry: Function to be executed in the context, which must never return
+ * @arg: Argument passed to @entry
+ *
+ * The context is not scheduled, and @entry is entered with preemption left as
+ * it is.
+ *
+ * Return: 0 if @sctx was properly initialized, or -1 in case of failure
+ */
+int uthread_stack_ctx_make(uthread_stack_ctx_t *sctx, void *top_of_stack,
+			   void (*entry)(void *), void *arg);
+
+/*
+ * uthread_stack_ctx_switch - Switch between two register-only contexts
+ * @prev: Pointer to the context in which to save the running code
+ * @next: Pointer to the context to resume
+ */
+void uthread_stack_ctx_switch(uthread_stack_ctx_t *prev,
+			      uthread_stack_ctx_t *next);
+
+/**
+ * Private scheduler API
+ */
+
+/* Thread states */
+#define Running 0
+#define Ready 1
+#define Blocked 2
+#define Zombie 3
+
+/* Number of thread-specific values stored inline in the TCB */
+#define UTHREAD_TLS_INLINE 8
+
+struct join_wait;
+struct arena_chunk;
+
+/* Cleanup handler, pushed by uthread_cleanup_push() */
+struct uthread_cleanup {
+	void (*routine)(void*);
+	void *arg;
+	struct uthread_cleanup *next;
+};
+
+/*
+ * struct TCB - Thread control block
+ *
+ * @arg is an optional argument handed to the thread at creation, for use by
+ * library functions running their own entry point (e.g. uthread_async()).
+ * A @detached thread is never joined: its TCB and stack are reclaimed by the
+ * library as soon as it exits.
+ *
+ * The values of the first UTHREAD_TLS_INLINE thread-specific keys are kept in
+ * @tls, the values of the other keys in @tls_spill, allocated on first use.
+ *
+ * A thread joining this thread, with uthread_join() or one of its variants,
+ * waits through @join_wait, in which this thread is at position @join_index.
+ * A sleeping thread waits for @wake_time, at position @timer_index of the
+ * timer heap (-1 when it is not in the heap). A thread waiting for a file
+ * descriptor receives the events which woke it up in @fd_events. A thread
+ * in uthread_wait_remote() has @remote_waiting set, and a wakeup from
+ * uthread_wake_remote() which came while it was not waiting sets
+ * @remote_token.
+ *
+ * Threads are linked to the thread which created them, their @parent, so that
+ * cancelling a thread also cancels its descendants. @cancel_pending is set once
+ * the thread is cancelled, and @exiting once it started to exit. @cleanup is
+ * the stack of its cleanup handlers.
+ *
+ * A thread belongs to the scheduling @group it is created in. A thread with a
+ * @deadline (0 if it has none) is scheduled before all the others, at position
+ * @edf_index of the deadline heap when it is ready (-1 otherwise).
+ *
+ * Memory from uthread_arena_alloc() comes from the chunks of @arena, the
+ * current one first, ending with @arena_tail. Allocations too large for a
+ * chunk each get their own chunk in @arena_large.
+ */
+struct TCB{
+	uthread_t TID;
+	uthread_ctx_t context;
+	int state;
+	void* stack;
+	int retval;
+	void *arg;
+	int detached;
+	void *tls[UTHREAD_TLS_INLINE];
+	void **tls_spill;
+	struct join_wait *join_wait;
+	int join_index;
+	struct TCB *parent;
+	struct TCB *children;
+	struct TCB *sibling_prev;
+	struct TCB *sibling_next;
+	int cancel_pending;
+	int exiting;
+	struct uthread_cleanup *cleanup;
+	struct uthread_group *group;
+	uint64_t deadline;
+	int edf_index;
+	/* entries left in the ready ring of the group by sched_remove() */
+	int ready_stale;
+	struct arena_chunk *arena;
+	struct arena_chunk *arena_tail;
+	struct arena_chunk *arena_large;
+	uint64_t wake_time;
+	int timer_index;
+	unsigned int fd_events;
+	int remote_waiting;
+	int remote_token;
+	/* deadline lent by the threads waiting for a mutex held by this one */
+	uint64_t inherited;
+	/* mutex this thread waits for, and boosted mutexes it holds */
+	uthread_mutex_t *blocked_on;
+	uthread_mutex_t *boosted;
+	/* CPU time used so far, and number of preemptions by the timer */
+	uint64_t run_time;
+	unsigned long preemptions;
+};
+
+/*
+ * tcb_deadline - Deadline a thread is scheduled by
+ * @tcb: TCB of the thread
+ *
+ * Return: The earliest of the deadline of @tcb and of the deadline it
+ * inherited, 0 if it has neither
+ */
+static inline uint64_t tcb_deadline(const struct TCB *tcb)
+{
+	if (tcb->inherited != 0 &&
+	    (tcb->deadline == 0 || tcb->inherited < tcb->deadline))
+		return tcb->inherited;
+
+	return tcb->deadline;
+}
+
+/*
+ * uthread_spawn - Create a new thread with an argument
+ * @func: Function to be executed by the thread
+ * @arg: Argument stored in the TCB of the new thread
+ * @detached: Whether the thread is reclaimed automatically when it exits
+ *
+ * Return: TCB of the new thread, already in the ready queue, or NULL in case
+ * of failure
+ */
+struct TCB *uthread_spawn(uthread_func_t func, void *arg, int detached);
+
+/*
+ * uthread_spawn_orphan - Create a detached thread from the scheduler
+ * @func: Function to be executed by the thread
+ * @arg: Argument stored in the TCB of the new thread
+ *
+ * Same as uthread_spawn(), except that the thread has no parent and belongs
+ * to the default group, and that no exited thread is reaped, so that the event
+ * loop can call it. Must be called with preemption disabled.
+ *
+ * Return: TCB of the new thread, already in the ready queue, or NULL in case
+ * of failure
+ */
+struct TCB *uthread_spawn_orphan(uthread_func_t func, void *arg);
+
+/*
+ * uthread_find - Find the thread of a handle
+ * @handle: Handle of the thread
+ *
+ * Must be called with preemption disabled.
+ *
+ * Return: TCB of the thread, or NULL if it was reclaimed
+ */
+struct TCB *uthread_find(uthread_handle_t handle);
+
+/*
+ * uthread_current - Get the TCB of the currently running thread
+ */
+struct TCB *uthread_current(void);
+
+/*
+ * uthread_resched - Let the other ready threads run
+ *
+ * Same as uthread_yield(), except that it is not a cancellation point. Used
+ * where the thread did not ask to yield: from the preemption signal handler,
+ * which may interrupt any library code, and when releasing a mutex or
+ * changing a deadline lets a more urgent thread run.
+ */
+void uthread_resched(void);
+
+/*
+ * uthread_block - Block the currently running thread
+ *
+ * The calling thread leaves the CPU and is not scheduled again until another
+ * thread calls uthread_unblock() on it. Callers should disable preemption
+ * before publishing themselves as waiters so that the wakeup cannot happen in
+ * between; preemption is enabled again when this function returns.
+ */
+void uthread_block(void);
+
+/*
+ * uthread_unblock - Unblock a thread
+ * @tcb: TCB of the blocked thread
+ *
+ * Put thread @tcb back into the ready queue, if it is still blocked. Must be
+ * called with preemption disabled.
+ *
+ * A blocked thread may also be woken up by a cancellation. Blocking functions
+ * must then remove the thread from what it was waiting for before calling
+ * uthread_testcancel(), so that no later wakeup reaches the thread.
+ */
+void uthread_unblock(struct TCB *tcb);
+
+/*
+ * uthread_unblock_batch - Unblock several threads at once
+ * @tcbs: TCBs of the blocked threads, overwritten
+ * @n: Number of threads in @tcbs
+ *
+ * Same as uthread_unblock() for each thread still blocked, except that the
+ * threads all go to the end of the ready queues, in the order of @tcbs, rather
+ * than through the run-next slot. Must be called with preemption disabled.
+ */
+void uthread_unblock_batch(struct TCB **tcbs, int n);
+
+/*
+ * uthread_walk - Call a function on every thread
+ * @fn: Function called with the TCB and the handle of each thread
+ * @arg: Argument passed to @fn
+ *
+ * Threads are visited in TID order, zombies included. @fn must not create or
+ * reclaim threads. Must be called with preemption disabled.
+ */
+void uthread_walk(void (*fn)(struct TCB *tcb, uthread_handle_t handle,
+			     void *arg), void *arg);
+
+/*
+ * uthread_boost - Lend a deadline to a thread
+ * @tcb: TCB of the thread, which does not run
+ * @deadline: Deadline to inherit, earlier than the one @tcb is scheduled by
+ *
+ * A ready thread moves to the queue matching its new deadline, and takes the
+ * CPU at once if it must run before the current thread. Must be called with
+ * preemption disabled.
+ */
+void uthread_boost(struct TCB *tcb, uint64_t deadline);
+
 
 /**
  * Private preemption API
+ *
+ * The cooperative-only build (UTHREAD_COOP) has no preemption: these functions
+ * are empty and compiled away.
  */
+#ifdef UTHREAD_COOP
+static inline void preempt_start(void) {}
+static inline void preempt_stop(void) {}
+static inline void preempt_enable(void) {}
+static inline void preempt_disable(void) {}
+static inline void preempt_resched(void) {}
+static inline void preempt_resched_at(uint64_t when) { (void)when; }
+#else
 
 /*
  * preempt_start - Start thread preemption
@@ -91,4 +386,374 @@ void preempt_enable(void);
  */
 void preempt_disable(void);
 
+/*
+ * preempt_resched - Preempt the running thread as soon as possible
+ *
+ * If preemption is started, the running thread yields as soon as preemption
+ * is enabled again, as on a timer tick. Does nothing otherwise.
+ */
+void preempt_resched(void);
+
+/*
+ * preempt_resched_at - Preempt the running thread at a given time
+ * @when: Time of the preemption, as returned by event_clock()
+ *
+ * If preemption is started, the running thread yields at @when, or earlier if
+ * another preemption was already requested. Does nothing otherwise.
+ */
+void preempt_resched_at(uint64_t when);
+#endif
+
+
+/**
+ * Private scheduling API
+ *
+ * Ready threads with a deadline wait in a heap ordered by deadline and always
+ * run first. The other ready threads wait in the FIFO queue of their group,
+ * and groups are ordered by virtual runtime. All these functions must be
+ * called with preemption disabled.
+ */
+
+/*
+ * sched_start - Create the default group
+ *
+ * Return: -1 in case of memory allocation error. 0 otherwise.
+ */
+int sched_start(void);
+
+/*
+ * sched_stop - Free the default group and the group heap
+ */
+void sched_stop(void);
+
+/*
+ * sched_attach - Make a new thread a member of a group
+ * @tcb: TCB of the new thread
+ * @group: Group of the thread, or NULL for the default group
+ */
+void sched_attach(struct TCB *tcb, struct uthread_group *group);
+
+/*
+ * sched_detach - Remove an exiting thread from its group
+ * @tcb: TCB of the exiting thread
+ */
+void sched_detach(struct TCB *tcb);
+
+/*
+ * sched_enqueue - Put a ready thread at the end of the queue of its group
+ * @tcb: TCB of the ready thread
+ */
+void sched_enqueue(struct TCB *tcb);
+
+/*
+ * sched_enqueue_batch - Put several ready threads at the end of their queues
+ * @tcbs: TCBs of the ready threads
+ * @n: Number of threads in @tcbs
+ *
+ * Same as sched_enqueue() for each thread, with the threads of a same group
+ * which follow each other in @tcbs appended together.
+ */
+void sched_enqueue_batch(struct TCB **tcbs, int n);
+
+/*
+ * sched_dequeue - Take the next thread to run out of the ready queues
+ *
+ * The next thread is the thread with the earliest deadline if there is one,
+ * otherwise the first thread of the group which is the most behind its share
+ * of the CPU.
+ *
+ * Return: The next thread to run, or NULL if no thread is ready
+ */
+struct TCB *sched_dequeue(void);
+
+/*
+ * sched_remove - Take a ready thread out of the queue of its group
+ * @tcb: TCB of the ready thread, which must be in the queue
+ *
+ * Amortized O(1): the entry of @tcb is only marked as stale, and dropped when
+ * it is dequeued or when the queue is compacted.
+ */
+void sched_remove(struct TCB *tcb);
+
+/*
+ * sched_ready - Number of threads in the ready queues
+ */
+int sched_ready(void);
+
+/*
+ * sched_urgent - Whether a thread with a deadline is ready
+ */
+int sched_urgent(void);
+
+/*
+ * sched_preempts - Whether a thread must run before another one
+ * @tcb: TCB of a ready thread
+ * @running: TCB of the running thread
+ *
+ * Deadlines inherited through mutexes count, see tcb_deadline().
+ *
+ * Return: 1 if @tcb has a deadline earlier than the one of @running, or if
+ * only @tcb has a deadline. 0 otherwise.
+ */
+int sched_preempts(struct TCB *tcb, struct TCB *running);
+
+/*
+ * sched_deadline_end - Account for the end of the deadline of a thread
+ * @tcb: TCB of the thread, which has a deadline
+ *
+ * Counts the deadline as met or missed, and makes @tcb a best-effort thread.
+ */
+void sched_deadline_end(struct TCB *tcb);
+
+/*
+ * sched_outranked - Whether a ready thread must run before another one
+ * @tcb: TCB of the running thread
+ */
+int sched_outranked(struct TCB *tcb);
+
+/*
+ * sched_inherit - Set the deadline a thread inherited
+ * @tcb: TCB of the thread, which is not in a ready queue
+ * @deadline: Inherited deadline, 0 for none
+ *
+ * A deadline earlier than the one @tcb was scheduled by counts as a boost in
+ * the statistics.
+ */
+void sched_inherit(struct TCB *tcb, uint64_t deadline);
+
+/*
+ * sched_now - Time of the last call to sched_charge()
+ *
+ * Return: Time in nanoseconds, see event_clock()
+ */
+uint64_t sched_now(void);
+
+/*
+ * sched_charge - Charge the CPU time used since the last call
+ * @tcb: TCB of the thread which used the CPU, or NULL to charge nobody
+ */
+void sched_charge(struct TCB *tcb);
+
+/**
+ * Private event API
+ */
+
+/*
+ * event_start - Start the event loop
+ *
+ * Return: 0 in case of success, -1 in case of failure
+ */
+int event_start(void);
+
+/*
+ * event_stop - Stop the event loop
+ */
+void event_stop(void);
+
+/*
+ * event_clock - Current time
+ *
+ * Return: Time elapsed since an arbitrary point, in nanoseconds
+ */
+uint64_t event_clock(void);
+
+/*
+ * event_notify - Wake the event loop up
+ *
+ * Make a blocking event_poll() return from its wait, so that the scheduler
+ * looks again for threads to run. Can be called from any kernel thread.
+ */
+void event_notify(void);
+
+/*
+ * event_poll - Wake up the threads whose events arrived
+ * @block: Whether to wait for an event when none arrived yet
+ *
+ * Unblock the sleeping threads whose wake time passed and the threads whose
+ * file descriptor is ready. Without @block, this function returns at once and
+ * only polls file descriptors every few calls. With @block, the kernel thread
+ * sleeps until at least one thread is woken up. Must be called with preemption
+ * disabled.
+ *
+ * Return: -1 if @block is set and no event can ever arrive. The number of
+ * threads woken up otherwise.
+ */
+int event_poll(int block);
+
+/**
+ * Private offload API
+ */
+
+/*
+ * offload_poll - Wake up the threads whose offloaded job completed
+ *
+ * Must be called with preemption disabled.
+ *
+ * Return: The number of threads woken up
+ */
+int offload_poll(void);
+
+/*
+ * offload_pending - Number of offloaded jobs which did not complete yet
+ */
+int offload_pending(void);
+
+/*
+ * offload_stop - Stop the helper threads of the offload pool
+ */
+void offload_stop(void);
+
+/**
+ * Private remote API
+ *
+ * Other kernel threads push their requests in a lock-free inbox, drained by
+ * the scheduler. These functions must be called with preemption disabled.
+ */
+
+/*
+ * remote_poll - Carry out the requests of other kernel threads
+ *
+ * Return: The number of threads created or woken up
+ */
+int remote_poll(void);
+
+/*
+ * remote_waiters - Number of threads waiting in uthread_wait_remote()
+ */
+int remote_waiters(void);
+
+/*
+ * remote_idle - Tell other kernel threads whether the event loop sleeps
+ * @idle: Whether the event loop is about to sleep
+ *
+ * Other kernel threads notify the event loop of their requests only while it
+ * sleeps, after remote_idle(1) and before remote_idle(0).
+ *
+ * Return: 1 if @idle is set and requests are already waiting, so that the
+ * event loop must not sleep. 0 otherwise.
+ */
+int remote_idle(int idle);
+
+/*
+ * remote_stop - Drop the requests which were not carried out
+ */
+void remote_stop(void);
+
+/**
+ * Private park API
+ */
+
+/*
+ * park_wait - Park the current thread on an address
+ * @addr: Address to wait on
+ * @expected: Value @addr must still hold for the thread to be parked
+ *
+ * Same as uthread_park(), but not a cancellation point: a cancellation only
+ * wakes the thread up, and the caller decides when to act on it. Must be called
+ * with preemption disabled, returns with preemption enabled.
+ *
+ * Return: -1 if @addr did not hold @expected, 0 if the thread was woken up by
+ * park_wake(), 1 if it was woken up by a cancellation.
+ */
+int park_wait(const int *addr, int expected);
+
+/*
+ * park_wake - Wake up the threads parked on an address
+ * @addr: Address the threads wait on
+ * @n: Maximum number of threads to wake up
+ *
+ * Threads are woken up in the order they were parked. When @n is 1, the woken
+ * thread runs next; otherwise the threads are made ready in batches, with
+ * uthread_unblock_batch(). Must be called with preemption disabled.
+ *
+ * Return: The number of threads woken up
+ */
+int park_wake(const int *addr, int n);
+
+/**
+ * Private affinity API
+ */
+
+/*
+ * affinity_pin_helper - Pin a helper kernel thread to its configured CPU
+ * @thread: Helper thread
+ * @index: Index of the helper in its pool
+ *
+ * Does nothing if no CPU list was configured.
+ */
+void affinity_pin_helper(pthread_t thread, int index);
+
+/*
+ * affinity_bind - Prefer the NUMA node of the scheduler for a memory range
+ * @addr: Start of the range, aligned on a page
+ * @len: Length of the range
+ *
+ * The pages of the range which are not touched yet will be allocated from the
+ * node of the scheduler thread, if it is known. Best effort: failures of the
+ * kernel are ignored, first-touch by the scheduler then applies.
+ */
+void affinity_bind(void *addr, size_t len);
+
+/*
+ * affinity_stop - Forget the configured CPU list
+ */
+void affinity_stop(void);
+
+/**
+ * Private thread-specific storage API
+ */
+
+/*
+ * uthread_tls_init - Initialize the thread-specific values of a thread
+ * @tcb: TCB of the new thread
+ */
+void uthread_tls_init(struct TCB *tcb);
+
+/*
+ * uthread_tls_exit - Destroy the thread-specific values of a thread
+ * @tcb: TCB of the exiting thread
+ *
+ * Call the destructors of the keys with a non-NULL value in @tcb, as long as
+ * destructors set new values, then free the storage of @tcb. Must be called by
+ * the exiting thread itself, as destructors may use uthread functions.
+ */
+void uthread_tls_exit(struct TCB *tcb);
+
+/**
+ * Private arena API
+ */
+
+/*
+ * uthread_arena_init - Initialize the arena of a thread
+ * @tcb: TCB of the new thread
+ */
+void uthread_arena_init(struct TCB *tcb);
+
+/*
+ * uthread_arena_exit - Release the arena of a thread
+ * @tcb: TCB of the exiting thread
+ *
+ * The regular chunks of the arena are spliced at once into the pool shared by
+ * all arenas, only large allocations are freed one by one. Must be called with
+ * preemption disabled.
+ */
+void uthread_arena_exit(struct TCB *tcb);
+
+/*
+ * uthread_arena_release - Free the chunks kept in the pool
+ */
+void uthread_arena_release(void);
+
+/**
+ * Private monitor API
+ */
+
+/*
+ * monitor_poll - Update the shared memory segment if it is due
+ *
+ * Called by the scheduler once it picked the next thread to run. Does nothing
+ * unless uthread_monitor_start() was called, and never reads the clock itself.
+ */
+void monitor_poll(void);
+
 #endif /* _UTHREAD_PRIVATE_H */
@@ -0,0 +1,285 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Maximum number of frames of a sample */
+#define PROFILE_DEPTH 32
+
+/* Number of samples the buffer holds until the next dump, a power of two */
+#define PROFILE_SAMPLES 8192
+
+/* Maximum length of a symbol name in the folded output */
+#define PROFILE_NAME 128
+
+/* not named by the C library before glibc 2.41 */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+struct sample {
+	uthread_t tid;
+	int depth;
+	/* innermost frame first */
+	uintptr_t pcs[PROFILE_DEPTH];
+};
+
+/*
+ * Single-producer single-consumer ring: the signal handler writes samples at
+ * @tail, the dump reads them from @head. Both run on the scheduler thread, the
+ * handler never waits for the dump.
+ */
+static struct sample samples[PROFILE_SAMPLES];
+static atomic_uint head, tail;
+static atomic_ulong dropped;
+
+static int profiling;
+static struct sigaction old_action;
+/* CPU time timer of the scheduler thread, the only one sampled */
+static timer_t profile_timer;
+static pthread_t profile_thread;
+
+/* stack of the kernel thread, on which the main thread runs */
+static uintptr_t main_stack_lo, main_stack_hi;
+
+/* walk the frame pointer chain, while it stays on the stack [lo, hi) */
+static int walk(struct sample *s, uintptr_t pc, uintptr_t fp, uintptr_t lo,
+		uintptr_t hi)
+{
+	int depth = 0;
+
+	s->pcs[depth++] = pc;
+	while (depth < PROFILE_DEPTH && fp >= lo && fp + 16 <= hi &&
+	       fp % sizeof(uintptr_t) == 0) {
+		uintptr_t *frame = (uintptr_t*)fp;
+
+		if (frame[1] == 0)
+			break;
+		s->pcs[depth++] = frame[1];
+
+		/* frames go up the stack, anything else is not a frame */
+		if (frame[0] <= fp)
+			break;
+		fp = frame[0];
+	}
+
+	return depth;
+}
+
+static void profile_handler(int signum, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+	struct TCB *tcb = uthread_current();
+	unsigned int t = atomic_load_explicit(&tail, memory_order_relaxed);
+	struct sample *s;
+	uintptr_t lo, hi;
+
+	(void)signum;
+	(void)info;
+
+	/*
+	 * a SIGPROF sent to the process may land on another kernel thread,
+	 * which must not write the ring nor be charged to a uthread
+	 */
+	if (tcb == NULL || !pthread_equal(pthread_self(), profile_thread))
+		return;
+
+	if (t - atomic_load_explicit(&head, memory_order_acquire) ==
+	    PROFILE_SAMPLES) {
+		atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	if (tcb->stack != NULL) {
+		lo = (uintptr_t)tcb->stack;
+		hi = lo + UTHREAD_STACK_SIZE;
+	} else {
+		lo = main_stack_lo;
+		hi = main_stack_hi;
+	}
+
+	s = &samples[t % PROFILE_SAMPLES];
+	s->tid = tcb->TID;
+#if defined(__x86_64__)
+	s->depth = walk(s, uc->uc_mcontext.gregs[REG_RIP],
+			uc->uc_mcontext.gregs[REG_RBP], lo, hi);
+#else
+	(void)uc;
+	(void)walk;
+	s->depth = 0;
+#endif
+
+	atomic_store_explicit(&tail, t + 1, memory_order_release);
+}
+
+int uthread_profile_start(unsigned int hz)
+{
+	struct sigaction sa;
+	struct sigevent sev;
+	struct itimerspec timer;
+	pthread_attr_t attr;
+	void *addr;
+	size_t size;
+
+	if (hz == 0 || hz > 1000000 || profiling)
+		return -1;
+
+#if !defined(__x86_64__)
+	/* the stack walk reads the registers of x86-64 only */
+	return -1;
+#endif
+
+	/* bounds of the stack of the main thread, for the stack walk */
+	if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+		if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+			main_stack_lo = (uintptr_t)addr;
+			main_stack_hi = (uintptr_t)addr + size;
+		}
+		pthread_attr_destroy(&attr);
+	}
+
+	sa.sa_sigaction = profile_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	if (sigaction(SIGPROF, &sa, &old_action) != 0)
+		return -1;
+
+	/*
+	 * CPU time of the scheduler thread only, user and system: the offload
+	 * helpers and the threads submitting remote jobs are not sampled
+	 */
+	profile_thread = pthread_self();
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_notify_thread_id = syscall(SYS_gettid);
+	sev.sigev_signo = SIGPROF;
+	sev.sigev_value.sival_ptr = NULL;
+	if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &profile_timer) != 0) {
+		sigaction(SIGPROF, &old_action, NULL);
+		return -1;
+	}
+
+	timer.it_interval.tv_sec = (1000000000 / hz) / 1000000000;
+	timer.it_interval.tv_nsec = (1000000000 / hz) % 1000000000;
+	timer.it_value = timer.it_interval;
+	if (timer_settime(profile_timer, 0, &timer, NULL) != 0) {
+		timer_delete(profile_timer);
+		sigaction(SIGPROF, &old_action, NULL);
+		return -1;
+	}
+
+	profiling = 1;
+
+	return 0;
+}
+
+void uthread_profile_stop(void)
+{
+	if (!profiling)
+		return;
+
+	timer_delete(profile_timer);
+	sigaction(SIGPROF, &old_action, NULL);
+	profiling = 0;
+}
+
+/* name of the function containing @pc, its address if it has no symbol */
+static void symbol(uintptr_t pc, char *name, size_t len)
+{
+	Dl_info info;
+
+	if (dladdr((void*)pc, &info) != 0 && info.dli_sname != NULL)
+		snprintf(name, len, "%s", info.dli_sname);
+	else
+		snprintf(name, len, "0x%lx", (unsigned long)pc);
+}
+
+/* one line of folded output, outermost frame first */
+static char *fold(struct sample *s)
+{
+	size_t len = 16 + s->depth * (PROFILE_NAME + 1);
+	char *line = malloc(len);
+	char name[PROFILE_NAME];
+	int pos;
+
+	if (line == NULL)
+		return NULL;
+
+	pos = snprintf(line, len, "uthread-%u", (unsigned int)s->tid);
+	for (int i = s->depth - 1; i >= 0; i--) {
+		/* return addresses point after the call, except the first pc */
+		symbol(i == 0 ? s->pcs[i] : s->pcs[i] - 1, name, sizeof(name));
+		pos += snprintf(line + pos, len - pos, ";%s", name);
+	}
+
+	return line;
+}
+
+static int compare(const void *a, const void *b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int uthread_profile_dump(const char *path)
+{
+	unsigned int h = atomic_load_explicit(&head, memory_order_relaxed);
+	unsigned int t = atomic_load_explicit(&tail, memory_order_acquire);
+	unsigned int n = t - h, i;
+	char **lines;
+	FILE *out;
+	int ret = 0;
+
+	if (path == NULL)
+		return -1;
+
+	lines = malloc((n ? n : 1) * sizeof(char*));
+	if (lines == NULL)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		lines[i] = fold(&samples[(h + i) % PROFILE_SAMPLES]);
+		if (lines[i] == NULL)
+			ret = -1;
+	}
+	/* the samples are consumed, the handler can reuse their slots */
+	atomic_store_explicit(&head, t, memory_order_release);
+
+	out = fopen(path, "w");
+	if (out == NULL)
+		ret = -1;
+
+	if (ret == 0) {
+		/* identical stacks are counted together */
+		qsort(lines, n, sizeof(char*), compare);
+		for (i = 0; i < n; ) {
+			unsigned int j = i + 1;
+
+			while (j < n && strcmp(lines[j], lines[i]) == 0)
+				j++;
+			fprintf(out, "%s %u\n", lines[i], j - i);
+			i = j;
+		}
+		if (atomic_exchange(&dropped, 0) > 0)
+			fprintf(stderr, "uthread: profile buffer full, samples dropped\n");
+	}
+
+	if (out != NULL && fclose(out) != 0)
+		ret = -1;
+	for (i = 0; i < n; i++)
+		free(lines[i]);
+	free(lines);
+
+	return ret;
+}
@@ -10,16 +10,38 @@ struct Node {
 	void *data;
 	struct Node *next_node;
 	struct Node *last_node;
+	/* list holding the node, checked by queue_remove_node() */
+	struct queue *queue;
 };
 
+/* Initial number of items of a ring buffer, must be a power of two */
+#define RING_CAPACITY 16
+
 struct queue {
+	queue_backend_t backend;
 	struct Node *front;
 	struct Node *rear;
 	int length;
+	/* ring buffer: items[head] is the oldest item, capacity is a power of 2 */
+	void **items;
+	int head;
+	int capacity;
+	/* position of the item being iterated, -1 when not iterating */
+	int iter_index;
+	/* list: next node to visit by the iteration in progress */
+	struct Node *iter_node;
 };
 
 queue_t queue_create(void)
 {
+	return queue_create_backend(QUEUE_LIST);
+}
+
+queue_t queue_create_backend(queue_backend_t backend)
+{
+	if (backend != QUEUE_LIST && backend != QUEUE_RING)
+		return NULL;
+
 	struct queue *Q = malloc(sizeof(struct queue));
 
 	/* malloc failed */
@@ -27,30 +49,309 @@ queue_t queue_create(void)
 		return NULL;
 
 	/* initialize queue */
+	Q->backend = backend;
 	Q->front = NULL;
 	Q->rear = NULL;
 	Q->length = 0;
+	Q->items = NULL;
+	Q->head = 0;
+	Q->capacity = 0;
+	Q->iter_index = -1;
+	Q->iter_node = NULL;
+
+	if (backend == QUEUE_RING) {
+		Q->items = malloc(RING_CAPACITY * sizeof(void*));
+		if (Q->items == NULL) {
+			free(Q);
+			return NULL;
+		}
+		Q->capacity = RING_CAPACITY;
+	}
 
 	return Q;
 
 }
 
+/* address of the item at position @i, 0 being the oldest item */
+static void **ring_slot(queue_t queue, int i)
+{
+	return &queue->items[(queue->head + i) & (queue->capacity - 1)];
+}
+
+/*
+ * make room for @count more items, doubling the capacity as many times as
+ * needed in a single allocation, and moving the oldest item at index 0
+ */
+static int ring_reserve(queue_t queue, int count)
+{
+	int capacity = queue->capacity;
+
+	while (capacity - queue->length < count)
+		capacity = capacity * 2;
+	if (capacity == queue->capacity)
+		return 0;
+
+	void **items = malloc(capacity * sizeof(void*));
+
+	/* malloc failed */
+	if (items == NULL)
+		return -1;
+
+	/* unwrap the ring in two contiguous copies */
+	int first = queue->capacity - queue->head;
+	if (first > queue->length)
+		first = queue->length;
+	memcpy(items, &queue->items[queue->head], first * sizeof(void*));
+	memcpy(&items[first], queue->items, (queue->length - first) * sizeof(void*));
+
+	free(queue->items);
+	queue->items = items;
+	queue->head = 0;
+	queue->capacity = capacity;
+
+	return 0;
+}
+
+/* append @n items after the newest one, room must have been reserved */
+static void ring_write(queue_t queue, void **items, int n)
+{
+	int tail = (queue->head + queue->length) & (queue->capacity - 1);
+	int first = queue->capacity - tail;
+
+	if (first > n)
+		first = n;
+	memcpy(&queue->items[tail], items, first * sizeof(void*));
+	memcpy(queue->items, &items[first], (n - first) * sizeof(void*));
+	queue->length = queue->length + n;
+}
+
+/* remove the @n oldest items into @items */
+static void ring_read(queue_t queue, void **items, int n)
+{
+	int first = queue->capacity - queue->head;
+
+	if (first > n)
+		first = n;
+	memcpy(items, &queue->items[queue->head], first * sizeof(void*));
+	memcpy(&items[first], queue->items, (n - first) * sizeof(void*));
+	queue->head = (queue->head + n) & (queue->capacity - 1);
+	queue->length = queue->length - n;
+
+	/* the item being iterated moved @n positions back */
+	if (queue->iter_index >= 0) {
+		queue->iter_index = queue->iter_index - n;
+		if (queue->iter_index < -1)
+			queue->iter_index = -1;
+	}
+}
+
+static int ring_enqueue(queue_t queue, void *data)
+{
+	if (queue->length == queue->capacity && ring_reserve(queue, 1) == -1)
+		return -1;
+
+	*ring_slot(queue, queue->length) = data;
+	queue->length = queue->length + 1;
+
+	return 0;
+}
+
+/* remove the item at position @i by shifting the items on its shorter side */
+static void ring_remove(queue_t queue, int i)
+{
+	int j;
+
+	if (i < queue->length / 2) {
+		/* move older items one step towards the newest */
+		for (j = i; j > 0; j--)
+			*ring_slot(queue, j) = *ring_slot(queue, j - 1);
+		queue->head = (queue->head + 1) & (queue->capacity - 1);
+	} else {
+		/* move newer items one step towards the oldest */
+		for (j = i; j < queue->length - 1; j++)
+			*ring_slot(queue, j) = *ring_slot(queue, j + 1);
+	}
+	queue->length = queue->length - 1;
+
+	/* the item being iterated moved one position back */
+	if (queue->iter_index >= 0 && i <= queue->iter_index)
+		queue->iter_index = queue->iter_index - 1;
+}
+
+static int ring_delete(queue_t queue, void *data)
+{
+	for (int i = 0; i < queue->length; i++) {
+		if (*ring_slot(queue, i) == data) {
+			ring_remove(queue, i);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static int ring_iterate(queue_t queue, queue_func_t func, void *arg, void **data)
+{
+	/* keep the position of an outer iteration, if any */
+	int outer_index = queue->iter_index;
+	void *current_data;
+
+	for (queue->iter_index = 0; queue->iter_index < queue->length;
+	     queue->iter_index++) {
+		current_data = *ring_slot(queue, queue->iter_index);
+		/* apply the function, which may delete items */
+		if ((*func)(queue, current_data, arg)) {
+			if (data != NULL)
+				*data = current_data;
+			break;
+		}
+	}
+
+	queue->iter_index = outer_index;
+
+	return 0;
+}
+
+/* free a chain of nodes, not their items */
+static void list_free(struct Node *node)
+{
+	struct Node *next_node;
+
+	for (; node != NULL; node = next_node) {
+		next_node = node->next_node;
+		free(node);
+	}
+}
+
+/*
+ * allocate a chain of nodes holding the @n items of @items and store its last
+ * node in @last, NULL in case of failure
+ */
+static struct Node *list_chain(void **items, int n, struct Node **last)
+{
+	struct Node *first = NULL, *prev = NULL;
+
+	for (int i = 0; i < n; i++) {
+		struct Node *N = malloc(sizeof(struct Node));
+
+		/* malloc failed, nothing was linked yet */
+		if (N == NULL) {
+			list_free(first);
+			return NULL;
+		}
+
+		N->data = items[i];
+		N->next_node = NULL;
+		N->last_node = prev;
+		if (prev == NULL)
+			first = N;
+		else
+			prev->next_node = N;
+		prev = N;
+	}
+
+	*last = prev;
+	return first;
+}
+
+/* link the chain of @n nodes from @first to @last after the newest node */
+static void list_append(queue_t queue, struct Node *first, struct Node *last,
+			int n)
+{
+	for (struct Node *N = first; N != NULL; N = N->next_node)
+		N->queue = queue;
+
+	first->last_node = queue->rear;
+	if (queue->rear == NULL)
+		queue->front = first;
+	else
+		queue->rear->next_node = first;
+	queue->rear = last;
+	queue->length = queue->length + n;
+
+	/* an iteration which already visited the newest node goes on here */
+	if (queue->iter_index >= 0 && queue->iter_node == NULL)
+		queue->iter_node = first;
+}
+
+/* detach @node from its neighbours, without freeing it */
+static void list_unlink(queue_t queue, struct Node *node)
+{
+	if (node->last_node == NULL)
+		queue->front = node->next_node;
+	else
+		node->last_node->next_node = node->next_node;
+
+	if (node->next_node == NULL)
+		queue->rear = node->last_node;
+	else
+		node->next_node->last_node = node->last_node;
+
+	/* the iteration skips a node removed before being visited */
+	if (queue->iter_node == node)
+		queue->iter_node = node->next_node;
+
+	queue->length = queue->length - 1;
+}
+
+static int list_iterate(queue_t queue, queue_func_t func, void *arg, void **data)
+{
+	/* keep the position of an outer iteration, if any */
+	int outer_index = queue->iter_index;
+	struct Node *outer_node = queue->iter_node;
+	struct Node *current_node = queue->front;
+	void *current_data;
+
+	/* only flags the iteration in progress for list_append() */
+	queue->iter_index = 0;
+
+	while (current_node != NULL) {
+		current_data = current_node->data;
+		/* move on first, the function may delete the current node */
+		queue->iter_node = current_node->next_node;
+		if ((*func)(queue, current_data, arg)) {
+			if (data != NULL)
+				*data = current_data;
+			break;
+		}
+		current_node = queue->iter_node;
+	}
+
+	queue->iter_index = outer_index;
+	queue->iter_node = outer_node;
+
+	return 0;
+}
+
 int queue_destroy(queue_t queue)
 {
 	if (queue == NULL || queue->length > 0) 
 		return -1;
 
+	free(queue->items);
 	free(queue);
 
 	return 0;
 }
 
 int queue_enqueue(queue_t queue, void *data)
+{
+	return queue_enqueue_node(queue, data, NULL);
+}
+
+int queue_enqueue_node(queue_t queue, void *data, queue_node_t *node)
 {
 
 	if (queue == NULL || data == NULL)
 		return -1;
 
+	if (queue->backend == QUEUE_RING) {
+		/* items of a ring move, they have no handle */
+		if (node != NULL)
+			return -1;
+		return ring_enqueue(queue, data);
+	}
+
 	struct Node *N = malloc(sizeof(struct Node)); 
 
 	/* malloc failed */
@@ -61,18 +362,41 @@ int queue_enqueue(queue_t queue, void *data)
 	N->next_node = NULL;
 	N->last_node = NULL;
 
-	if (queue->length == 0) {
-		/* for empty queue, front and rear should point to the same node */
-		queue->front = N;
-		queue->rear = N;
-	} else {
-		/* add the new node at the end of the queue */
-		N->last_node = queue->rear;
-		queue->rear->next_node = N; 
-		queue->rear = N;
+	/* add the new node at the end of the queue */
+	list_append(queue, N, N, 1);
+
+	if (node != NULL)
+		*node = N;
+
+	return 0;
+}
+
+int queue_enqueue_batch(queue_t queue, void **items, int n)
+{
+	struct Node *first, *last;
+
+	if (queue == NULL || items == NULL || n < 0)
+		return -1;
+
+	/* check every item first, the batch is enqueued entirely or not at all */
+	for (int i = 0; i < n; i++) {
+		if (items[i] == NULL)
+			return -1;
+	}
+	if (n == 0)
+		return 0;
+
+	if (queue->backend == QUEUE_RING) {
+		if (ring_reserve(queue, n) == -1)
+			return -1;
+		ring_write(queue, items, n);
+		return 0;
 	}
 
-	queue->length = queue->length + 1;
+	first = list_chain(items, n, &last);
+	if (first == NULL)
+		return -1;
+	list_append(queue, first, last, n);
 
 	return 0;
 }
@@ -80,88 +404,156 @@ int queue_enqueue(queue_t queue, void *data)
 int queue_dequeue(queue_t queue, void **data)
 {
 	
-	if (queue->length == 0 || queue == NULL || data == NULL)
+	if (queue == NULL || data == NULL || queue->length == 0)
 		return -1;
 
+	if (queue->backend == QUEUE_RING) {
+		/* removing the oldest item only moves the head */
+		ring_read(queue, data, 1);
+		return 0;
+	}
+
 	/* store the first node */
 	struct Node *first_node = queue->front;
 
 	/* dequeue the first node*/
-	*data = queue->front->data;
-	first_node = queue->front;
-	queue->front = queue->front->next_node;
+	*data = first_node->data;
+	list_unlink(queue, first_node);
 
 	/* recycle the memory address */
 	free(first_node);
 
-	/* if the queue is empty after dequeue */
-	if (queue->front == NULL)
-		queue->rear = NULL;
-	
-	queue->length = queue->length - 1;
-
 	return 0;
 }
 
+int queue_dequeue_batch(queue_t queue, void **items, int max)
+{
+	if (queue == NULL || items == NULL || max < 0)
+		return -1;
+
+	if (max > queue->length)
+		max = queue->length;
+
+	if (queue->backend == QUEUE_RING) {
+		ring_read(queue, items, max);
+		return max;
+	}
+
+	for (int i = 0; i < max; i++) {
+		struct Node *first_node = queue->front;
+
+		items[i] = first_node->data;
+		list_unlink(queue, first_node);
+		free(first_node);
+	}
+
+	return max;
+}
+
 int queue_delete(queue_t queue, void *data)
 {
 	if (queue == NULL || queue->length == 0 || data == NULL)
 		return -1; 
 
-	/* set default status to -1, failure */
-	int delete_status = -1;
-	struct Node *current_node = queue->front;
-	for (int i = 1; i < queue->length; i++) {
-		if (current_node->data == data) {
-
-			if (current_node->last_node == NULL) {
-				queue->front = current_node->next_node;
-				current_node->next_node->last_node = NULL;
-			} else {
-				/* link the last_node to the next_node */
-				current_node->last_node->next_node = current_node->next_node;
-			}
-
-			queue->length = queue->length - 1;
-			if (queue->length == 0) {
-				queue->front = NULL;
-				queue->rear = NULL;
-			}
+	if (queue->backend == QUEUE_RING)
+		return ring_delete(queue, data);
 
+	struct Node *current_node;
+	for (current_node = queue->front; current_node != NULL;
+	     current_node = current_node->next_node) {
+		if (current_node->data == data) {
+			list_unlink(queue, current_node);
 			/* recycle the memory address */
 			free(current_node);
-			/* change the status to 0, success */
-			delete_status = 0;
-			break;
-		} else {
-			current_node = current_node->next_node;
+			return 0;
 		}
 	}
-	return delete_status;
+
+	return -1;
 }
 
-int queue_iterate(queue_t queue, queue_func_t func, void *arg, void **data)
+int queue_remove_node(queue_t queue, queue_node_t node)
 {
-	if (queue == NULL || func == NULL)
+	if (queue == NULL || node == NULL || queue->backend != QUEUE_LIST ||
+	    node->queue != queue)
 		return -1;
 
-	struct Node *current_node = queue->front;
-	void *current_data;
+	list_unlink(queue, node);
+	free(node);
 
-	for (int i = 0; i < queue->length; i++) {
-		current_data = current_node->data;
-		/* iterate the queue */
-		current_node = current_node->next_node;
-		/* apply the function */ 
-		if ((*func)(queue, current_data, arg)) {
-			if (data != NULL)
-				*data = current_data;
-			break;
+	return 0;
+}
+
+int queue_splice(queue_t dst, queue_t src)
+{
+	if (dst == NULL || src == NULL || dst == src)
+		return -1;
+
+	if (src->length == 0)
+		return 0;
+
+	/* oldest items of a ring source, in two contiguous runs */
+	int first = src->capacity - src->head;
+	if (first > src->length)
+		first = src->length;
+
+	if (src->backend == QUEUE_LIST && dst->backend == QUEUE_LIST) {
+		/* relink the nodes, their handles now belong to @dst */
+		list_append(dst, src->front, src->rear, src->length);
+	} else if (dst->backend == QUEUE_RING) {
+		if (ring_reserve(dst, src->length) == -1)
+			return -1;
+
+		if (src->backend == QUEUE_RING) {
+			ring_write(dst, &src->items[src->head], first);
+			ring_write(dst, src->items, src->length - first);
+		} else {
+			for (struct Node *N = src->front; N != NULL; N = N->next_node)
+				ring_write(dst, &N->data, 1);
+			list_free(src->front);
 		}
+	} else {
+		/* a ring into a list, allocate every node before linking any */
+		struct Node *front, *rear, *second, *second_rear;
+
+		front = list_chain(&src->items[src->head], first, &rear);
+		if (front == NULL)
+			return -1;
+		if (src->length > first) {
+			second = list_chain(src->items, src->length - first,
+					    &second_rear);
+			if (second == NULL) {
+				list_free(front);
+				return -1;
+			}
+			rear->next_node = second;
+			second->last_node = rear;
+			rear = second_rear;
+		}
+		list_append(dst, front, rear, src->length);
 	}
 
+	/* @src is left empty, an iteration of it has nothing left to visit */
+	src->front = NULL;
+	src->rear = NULL;
+	src->length = 0;
+	src->head = 0;
+	src->iter_node = NULL;
+	if (src->backend == QUEUE_RING && src->iter_index >= 0)
+		src->iter_index = -1;
+
 	return 0;
+}
 
+int queue_iterate(queue_t queue, queue_func_t func, void *arg, void **data)
+{
+	if (queue == NULL || func == NULL)
+		return -1;
+
+	if (queue->backend == QUEUE_RING)
+		return ring_iterate(queue, func, arg, data);
+
+	return list_iterate(queue, func, arg, data);
 }
 
 int queue_length(queue_t queue)
@@ -170,5 +562,3 @@ int queue_length(queue_t queue)
 		return -1; 
 	return queue->length;
 }
-
-
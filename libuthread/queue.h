@@ -9,19 +9,59 @@
  * first and so on.
  *
  * Apart from delete and iterate operations, all operations should be O(1).
+ * Batch operations are O(n) in the number of items they move, and splicing two
+ * linked lists takes one pass over the moved nodes, without any allocation.
  */
 typedef struct queue* queue_t;
 
+/*
+ * queue_node_t - Handle of an item of a QUEUE_LIST queue
+ *
+ * Returned by queue_enqueue_node(), it lets queue_remove_node() unlink the
+ * item without searching for it. A handle is valid until its item leaves the
+ * queue, or follows the item when queue_splice() moves it to another list.
+ */
+typedef struct Node* queue_node_t;
+
+/*
+ * queue_backend_t - Queue storage type
+ *
+ * QUEUE_LIST stores items in a doubly linked list, with one node allocated per
+ * enqueued item.
+ *
+ * QUEUE_RING stores items contiguously in a ring buffer whose capacity is a
+ * power of two, doubled when full. Enqueue and dequeue are amortized O(1)
+ * without any allocation, and iterating walks memory sequentially. Deleting an
+ * item shifts the items on its shorter side.
+ */
+typedef enum {
+	QUEUE_LIST,
+	QUEUE_RING,
+} queue_backend_t;
+
 /*
  * queue_create - Allocate an empty queue
  *
- * Create a new object of type 'struct queue' and return its address.
+ * Create a new object of type 'struct queue' and return its address. The
+ * queue uses the QUEUE_LIST backend.
  *
  * Return: Pointer to new empty queue. NULL in case of failure when allocating
  * the new queue.
  */
 queue_t queue_create(void);
 
+/*
+ * queue_create_backend - Allocate an empty queue with a given backend
+ * @backend: Storage type of the queue
+ *
+ * Same as queue_create(), with the items of the queue stored by @backend. All
+ * the other queue operations behave the same for every backend.
+ *
+ * Return: Pointer to new empty queue. NULL if @backend is unknown or in case of
+ * failure when allocating the new queue.
+ */
+queue_t queue_create_backend(queue_backend_t backend);
+
 /*
  * queue_destroy - Deallocate a queue
  * @queue: Queue to deallocate
@@ -45,6 +85,37 @@ int queue_destroy(queue_t queue);
  */
 int queue_enqueue(queue_t queue, void *data);
 
+/*
+ * queue_enqueue_node - Enqueue data item and get its handle
+ * @queue: Queue in which to enqueue item
+ * @data: Address of data item to enqueue
+ * @node: (Optional) Address of handle where the node of the item is received
+ *
+ * Same as queue_enqueue(), and if @node is not NULL, store in @node the handle
+ * of the new item for queue_remove_node(). Only QUEUE_LIST queues have handles.
+ *
+ * Return: -1 if @queue or @data are NULL, if @node is not NULL and @queue is a
+ * QUEUE_RING queue, or in case of memory allocation error when enqueing. 0 if
+ * @data was successfully enqueued in @queue.
+ */
+int queue_enqueue_node(queue_t queue, void *data, queue_node_t *node);
+
+/*
+ * queue_enqueue_batch - Enqueue several data items
+ * @queue: Queue in which to enqueue items
+ * @items: Array of data items to enqueue
+ * @n: Number of items in @items
+ *
+ * Enqueue the @n items of @items in order, as @n calls to queue_enqueue()
+ * would. A QUEUE_RING queue grows at most once and copies the items in bulk; a
+ * QUEUE_LIST queue allocates all the nodes before linking the whole chain.
+ *
+ * Return: -1 if @queue or @items are NULL, if @n is negative, if one of the
+ * first @n items is NULL, or in case of memory allocation error, and then no
+ * item was enqueued. 0 if the items were successfully enqueued in @queue.
+ */
+int queue_enqueue_batch(queue_t queue, void **items, int n);
+
 /*
  * queue_dequeue - Dequeue data item
  * @queue: Queue in which to dequeue item
@@ -58,6 +129,20 @@ int queue_enqueue(queue_t queue, void *data);
  */
 int queue_dequeue(queue_t queue, void **data);
 
+/*
+ * queue_dequeue_batch - Dequeue several data items
+ * @queue: Queue in which to dequeue items
+ * @items: Array receiving the dequeued items
+ * @max: Maximum number of items to dequeue
+ *
+ * Remove up to @max of the oldest items of @queue and store them in @items
+ * from the oldest to the newest.
+ *
+ * Return: -1 if @queue or @items are NULL, or if @max is negative. The number
+ * of items dequeued otherwise.
+ */
+int queue_dequeue_batch(queue_t queue, void **items, int max);
+
 /*
  * queue_delete - Delete data item
  * @queue: Queue in which to delete item
@@ -71,6 +156,37 @@ int queue_dequeue(queue_t queue, void **data);
  */
 int queue_delete(queue_t queue, void *data);
 
+/*
+ * queue_remove_node - Remove data item by handle
+ * @queue: QUEUE_LIST queue holding the item
+ * @node: Handle of the item, received from queue_enqueue_node()
+ *
+ * Unlink the item of handle @node from @queue in O(1), wherever it is in the
+ * queue. The handle must designate an item which is still queued, and is no
+ * longer valid afterwards.
+ *
+ * Return: -1 if @queue or @node are NULL, if @queue is not a QUEUE_LIST queue,
+ * or if the item of @node is queued in another queue. 0 if the item was removed
+ * from @queue.
+ */
+int queue_remove_node(queue_t queue, queue_node_t node);
+
+/*
+ * queue_splice - Move all the items of a queue to the end of another
+ * @dst: Queue receiving the items
+ * @src: Queue whose items are moved
+ *
+ * Append the items of @src to @dst, oldest first, and leave @src empty. Between
+ * two QUEUE_LIST queues the nodes are relinked without any allocation, in one
+ * pass which hands their handles over to @dst. A QUEUE_RING @dst grows at most
+ * once and copies the items in bulk.
+ *
+ * Return: -1 if @dst or @src are NULL, if they are the same queue, or in case
+ * of memory allocation error, and then both queues are unchanged. 0 if the
+ * items of @src were moved to @dst.
+ */
+int queue_splice(queue_t dst, queue_t src);
+
 /*
  * queue_func_t - Queue callback function type
  * @queue: Queue to which item belongs
@@ -0,0 +1,244 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/*
+ * Maximum number of threads created by a scheduling pass, which only creates
+ * threads while fewer threads than that are ready
+ */
+#define REMOTE_BATCH 64
+
+/*
+ * A request from another kernel thread: a function to run in a new thread, or
+ * the wakeup of the thread of @handle if @func is NULL
+ */
+struct remote_msg {
+	uthread_async_func_t func;
+	void *arg;
+	uthread_handle_t handle;
+	struct remote_msg *next;
+};
+
+/*
+ * Inbox of the requests, pushed by any kernel thread and emptied at once by
+ * the scheduler, in the reverse order of their arrival
+ */
+static _Atomic(struct remote_msg*) inbox;
+/* whether the event loop sleeps and must be notified of new requests */
+static atomic_int loop_idle;
+
+/* threads to create, taken from the inbox, in arrival order */
+static struct remote_msg *backlog, *backlog_tail;
+
+/* number of threads in uthread_wait_remote() */
+static int waiters;
+
+/* push a request, from any kernel thread */
+static void inbox_push(struct remote_msg *msg)
+{
+	struct remote_msg *head = atomic_load_explicit(&inbox,
+						       memory_order_relaxed);
+
+	do {
+		msg->next = head;
+	} while (!atomic_compare_exchange_weak(&inbox, &head, msg));
+
+	/* the scheduler is running, it drains the inbox at its next pass */
+	if (atomic_load(&loop_idle))
+		event_notify();
+}
+
+/* entry point of the threads created by uthread_submit_remote() */
+static int remote_entry(void)
+{
+	struct remote_msg *msg = uthread_current()->arg;
+	uthread_async_func_t func = msg->func;
+	void *arg = msg->arg;
+
+	free(msg);
+	func(arg);
+
+	return 0;
+}
+
+/* wake up the thread of a handle, unless it was reclaimed since */
+static int remote_wake(uthread_handle_t handle)
+{
+	struct TCB *tcb = uthread_find(handle);
+
+	if (tcb == NULL || tcb->state == Zombie)
+		return 0;
+
+	/* not waiting yet, the wakeup is kept for its next wait */
+	if (!tcb->remote_waiting) {
+		tcb->remote_token = 1;
+		return 0;
+	}
+
+	tcb->remote_waiting = 0;
+	uthread_unblock(tcb);
+
+	return 1;
+}
+
+/*
+ * empty the inbox, carry out the wakeups and move the other requests at the
+ * end of the backlog
+ *
+ * Return: The number of threads woken up
+ */
+static int inbox_drain(void)
+{
+	struct remote_msg *msg, *next, *batch = NULL;
+	int woken = 0;
+
+	if (atomic_load_explicit(&inbox, memory_order_relaxed) == NULL)
+		return 0;
+
+	/* take the whole inbox, and put the requests back in arrival order */
+	msg = atomic_exchange(&inbox, NULL);
+	while (msg != NULL) {
+		next = msg->next;
+		msg->next = batch;
+		batch = msg;
+		msg = next;
+	}
+
+	for (msg = batch; msg != NULL; msg = next) {
+		next = msg->next;
+
+		if (msg->func == NULL) {
+			woken += remote_wake(msg->handle);
+			free(msg);
+			continue;
+		}
+
+		msg->next = NULL;
+		if (backlog == NULL)
+			backlog = msg;
+		else
+			backlog_tail->next = msg;
+		backlog_tail = msg;
+	}
+
+	return woken;
+}
+
+int remote_poll(void)
+{
+	struct remote_msg *msg;
+	int woken = inbox_drain();
+
+	/* a burst of requests waits for the threads already ready to run */
+	while (backlog != NULL && sched_ready() < REMOTE_BATCH) {
+		msg = backlog;
+		backlog = msg->next;
+
+		if (uthread_spawn_orphan(remote_entry, msg) != NULL) {
+			/* freed by the new thread */
+			woken++;
+		} else {
+			free(msg);
+		}
+	}
+
+	return woken;
+}
+
+int remote_waiters(void)
+{
+	return waiters;
+}
+
+int remote_idle(int idle)
+{
+	atomic_store(&loop_idle, idle);
+
+	/* a request pushed before the store was not notified */
+	return idle && (backlog != NULL || atomic_load(&inbox) != NULL);
+}
+
+/* free a list of requests */
+static void msg_free(struct remote_msg *msg)
+{
+	while (msg != NULL) {
+		struct remote_msg *next = msg->next;
+
+		free(msg);
+		msg = next;
+	}
+}
+
+void remote_stop(void)
+{
+	msg_free(atomic_exchange(&inbox, NULL));
+	msg_free(backlog);
+	backlog = backlog_tail = NULL;
+	waiters = 0;
+}
+
+/* allocate a request and push it, from any kernel thread */
+static int remote_send(uthread_async_func_t func, void *arg,
+		       uthread_handle_t handle)
+{
+	struct remote_msg *msg = malloc(sizeof(struct remote_msg));
+
+	/* malloc failed */
+	if (msg == NULL)
+		return -1;
+
+	msg->func = func;
+	msg->arg = arg;
+	msg->handle = handle;
+	inbox_push(msg);
+
+	return 0;
+}
+
+int uthread_submit_remote(uthread_async_func_t func, void *arg)
+{
+	if (func == NULL)
+		return -1;
+
+	return remote_send(func, arg, UTHREAD_HANDLE_INVALID);
+}
+
+int uthread_wake_remote(uthread_handle_t handle)
+{
+	if (handle == UTHREAD_HANDLE_INVALID)
+		return -1;
+
+	return remote_send(NULL, NULL, handle);
+}
+
+void uthread_wait_remote(void)
+{
+	struct TCB *tcb = uthread_current();
+
+	uthread_testcancel();
+
+	preempt_disable();
+
+	/* a wakeup arrived before the wait */
+	if (tcb->remote_token) {
+		tcb->remote_token = 0;
+		preempt_enable();
+		return;
+	}
+
+	tcb->remote_waiting = 1;
+	waiters++;
+
+	/* woken up by remote_poll(), or by a cancellation */
+	uthread_block();
+
+	preempt_disable();
+	tcb->remote_waiting = 0;
+	waiters--;
+	preempt_enable();
+
+	uthread_testcancel();
+}
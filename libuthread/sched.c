@@ -0,0 +1,573 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "queue.h"
+#include "uthread.h"
+
+/* Weight of the default group, against which virtual runtime is measured */
+#define SCHED_WEIGHT_DEFAULT 1024
+
+/* Initial capacity of the group and deadline heaps */
+#define SCHED_HEAP_CAPACITY 8
+
+/*
+ * A scheduling group. Groups with ready threads are kept in a min-heap ordered
+ * by virtual runtime, which grows with the CPU time of the group divided by
+ * its weight: the group which received the least of its share runs next.
+ * Threads of a group run in FIFO order.
+ *
+ * A thread taken out of the ready ring by sched_remove() leaves a stale entry
+ * behind, skipped when it is dequeued: a ring can only delete an item by
+ * searching for it. The ring is compacted once most of its entries are stale.
+ */
+struct uthread_group {
+	unsigned int weight;
+	uint64_t vruntime;
+	uint64_t cpu_time;
+	queue_t ready;
+	/* ready threads of the group, and stale entries of @ready */
+	int queued;
+	int stale;
+	/* position in the heap, -1 when the group has no ready thread */
+	int heap_index;
+	/* threads of the group which did not exit yet */
+	int threads;
+};
+
+static struct uthread_group default_group;
+
+static struct uthread_group **heap;
+static int heap_count, heap_capacity;
+
+/* lower bound of the virtual runtime of the runnable groups */
+static uint64_t min_vruntime;
+
+/* number of ready threads, in all groups */
+static int ready_count;
+
+/* start of the time slice of the running thread */
+static uint64_t slice_start;
+
+/* min-heap of the ready threads with a deadline */
+static struct TCB **edf;
+static int edf_count, edf_capacity;
+
+static unsigned long deadlines_met, deadlines_missed;
+static unsigned long mutex_boosts;
+
+static void heap_set(int i, struct uthread_group *group)
+{
+	heap[i] = group;
+	group->heap_index = i;
+}
+
+static void heap_up(int i)
+{
+	struct uthread_group *group = heap[i];
+
+	while (i > 0 && heap[(i - 1) / 2]->vruntime > group->vruntime) {
+		heap_set(i, heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	heap_set(i, group);
+}
+
+static void heap_down(int i)
+{
+	struct uthread_group *group = heap[i];
+
+	while (2 * i + 1 < heap_count) {
+		int child = 2 * i + 1;
+
+		if (child + 1 < heap_count &&
+		    heap[child + 1]->vruntime < heap[child]->vruntime)
+			child++;
+		if (heap[child]->vruntime >= group->vruntime)
+			break;
+		heap_set(i, heap[child]);
+		i = child;
+	}
+	heap_set(i, group);
+}
+
+static int heap_push(struct uthread_group *group)
+{
+	if (heap_count == heap_capacity) {
+		int capacity = heap_capacity ? heap_capacity * 2 :
+			SCHED_HEAP_CAPACITY;
+		struct uthread_group **grown = realloc(heap,
+			capacity * sizeof(struct uthread_group*));
+
+		/* malloc failed */
+		if (grown == NULL)
+			return -1;
+
+		heap = grown;
+		heap_capacity = capacity;
+	}
+
+	heap[heap_count] = group;
+	heap_count++;
+	heap_up(heap_count - 1);
+
+	return 0;
+}
+
+static void heap_remove(struct uthread_group *group)
+{
+	int i = group->heap_index;
+
+	heap_count--;
+	if (i < heap_count) {
+		struct uthread_group *last = heap[heap_count];
+
+		heap_set(i, last);
+		heap_up(i);
+		heap_down(last->heap_index);
+	}
+	group->heap_index = -1;
+}
+
+static void edf_set(int i, struct TCB *tcb)
+{
+	edf[i] = tcb;
+	tcb->edf_index = i;
+}
+
+static void edf_up(int i)
+{
+	struct TCB *tcb = edf[i];
+
+	while (i > 0 && tcb_deadline(edf[(i - 1) / 2]) > tcb_deadline(tcb)) {
+		edf_set(i, edf[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	edf_set(i, tcb);
+}
+
+static void edf_down(int i)
+{
+	struct TCB *tcb = edf[i];
+
+	while (2 * i + 1 < edf_count) {
+		int child = 2 * i + 1;
+
+		if (child + 1 < edf_count &&
+		    tcb_deadline(edf[child + 1]) < tcb_deadline(edf[child]))
+			child++;
+		if (tcb_deadline(edf[child]) >= tcb_deadline(tcb))
+			break;
+		edf_set(i, edf[child]);
+		i = child;
+	}
+	edf_set(i, tcb);
+}
+
+static void edf_push(struct TCB *tcb)
+{
+	if (edf_count == edf_capacity) {
+		int capacity = edf_capacity ? edf_capacity * 2 :
+			SCHED_HEAP_CAPACITY;
+		struct TCB **grown = realloc(edf, capacity * sizeof(struct TCB*));
+
+		/* malloc failed */
+		if (grown == NULL) {
+			perror("realloc in edf_push");
+			exit(1);
+		}
+
+		edf = grown;
+		edf_capacity = capacity;
+	}
+
+	edf[edf_count] = tcb;
+	edf_count++;
+	edf_up(edf_count - 1);
+}
+
+static void edf_remove(struct TCB *tcb)
+{
+	int i = tcb->edf_index;
+
+	edf_count--;
+	if (i < edf_count) {
+		struct TCB *last = edf[edf_count];
+
+		edf_set(i, last);
+		edf_up(i);
+		edf_down(last->edf_index);
+	}
+	tcb->edf_index = -1;
+}
+
+static int group_init(struct uthread_group *group, unsigned int weight)
+{
+	group->ready = queue_create_backend(QUEUE_RING);
+	if (group->ready == NULL)
+		return -1;
+
+	group->weight = weight;
+	group->vruntime = min_vruntime;
+	group->cpu_time = 0;
+	group->heap_index = -1;
+	group->threads = 0;
+	group->queued = 0;
+	group->stale = 0;
+
+	return 0;
+}
+
+int sched_start(void)
+{
+	min_vruntime = 0;
+	ready_count = 0;
+	slice_start = event_clock();
+
+	return group_init(&default_group, SCHED_WEIGHT_DEFAULT);
+}
+
+void sched_stop(void)
+{
+	queue_destroy(default_group.ready);
+	free(heap);
+	heap = NULL;
+	heap_count = heap_capacity = 0;
+	free(edf);
+	edf = NULL;
+	edf_count = edf_capacity = 0;
+}
+
+void sched_attach(struct TCB *tcb, struct uthread_group *group)
+{
+	if (group == NULL)
+		group = &default_group;
+
+	tcb->group = group;
+	group->threads++;
+	tcb->deadline = 0;
+	tcb->edf_index = -1;
+	tcb->ready_stale = 0;
+	tcb->inherited = 0;
+	tcb->blocked_on = NULL;
+	tcb->boosted = NULL;
+	tcb->run_time = 0;
+	tcb->preemptions = 0;
+}
+
+/* drop the stale entries of the ready ring of @group */
+static void group_compact(struct uthread_group *group)
+{
+	struct TCB *tcb;
+	int n = queue_length(group->ready);
+
+	for (int i = 0; i < n; i++) {
+		queue_dequeue(group->ready, (void**)&tcb);
+		/* the entries of a thread older than its live one are stale */
+		if (tcb->ready_stale > 0)
+			tcb->ready_stale--;
+		else
+			queue_enqueue(group->ready, tcb);
+	}
+	group->stale = 0;
+}
+
+void sched_detach(struct TCB *tcb)
+{
+	tcb->group->threads--;
+
+	/* the ring must not keep pointing to a thread about to be freed */
+	if (tcb->ready_stale > 0)
+		group_compact(tcb->group);
+}
+
+/* put a group with new ready threads in the heap, if it is not there yet */
+static void group_activate(struct uthread_group *group)
+{
+	if (group->heap_index != -1)
+		return;
+
+	/* an idle group does not get credit for the time it slept */
+	if (group->vruntime < min_vruntime)
+		group->vruntime = min_vruntime;
+	if (heap_push(group) == -1) {
+		perror("realloc in sched_enqueue");
+		exit(1);
+	}
+}
+
+void sched_enqueue(struct TCB *tcb)
+{
+	struct uthread_group *group = tcb->group;
+
+	if (tcb_deadline(tcb) != 0) {
+		edf_push(tcb);
+		ready_count++;
+		return;
+	}
+
+	queue_enqueue(group->ready, tcb);
+	group->queued++;
+	ready_count++;
+	group_activate(group);
+}
+
+void sched_enqueue_batch(struct TCB **tcbs, int n)
+{
+	int i = 0, start;
+
+	while (i < n) {
+		struct uthread_group *group = tcbs[i]->group;
+
+		if (tcb_deadline(tcbs[i]) != 0) {
+			sched_enqueue(tcbs[i++]);
+			continue;
+		}
+
+		/* a run of threads of the same group */
+		start = i;
+		while (i < n && tcbs[i]->group == group &&
+		       tcb_deadline(tcbs[i]) == 0)
+			i++;
+
+		if (queue_enqueue_batch(group->ready, (void**)&tcbs[start],
+					i - start) == -1) {
+			perror("malloc in sched_enqueue_batch");
+			exit(1);
+		}
+		group->queued += i - start;
+		ready_count += i - start;
+		group_activate(group);
+	}
+}
+
+struct TCB *sched_dequeue(void)
+{
+	struct uthread_group *group;
+	struct TCB *tcb;
+
+	/* threads with a deadline first, earliest deadline first */
+	if (edf_count > 0) {
+		tcb = edf[0];
+		edf_remove(tcb);
+		ready_count--;
+		return tcb;
+	}
+
+	if (heap_count == 0)
+		return NULL;
+
+	group = heap[0];
+	if (group->vruntime > min_vruntime)
+		min_vruntime = group->vruntime;
+
+	/* skip the entries of the threads taken out by sched_remove() */
+	for (;;) {
+		queue_dequeue(group->ready, (void**)&tcb);
+		if (tcb->ready_stale == 0)
+			break;
+		tcb->ready_stale--;
+		group->stale--;
+	}
+	group->queued--;
+	ready_count--;
+	if (group->queued == 0) {
+		heap_remove(group);
+		group_compact(group);
+	}
+
+	return tcb;
+}
+
+void sched_remove(struct TCB *tcb)
+{
+	struct uthread_group *group = tcb->group;
+
+	ready_count--;
+	if (tcb->edf_index != -1) {
+		edf_remove(tcb);
+		return;
+	}
+
+	/* leave the entry in the ring, sched_dequeue() skips it */
+	tcb->ready_stale++;
+	group->stale++;
+	group->queued--;
+	if (group->queued == 0) {
+		heap_remove(group);
+		group_compact(group);
+	} else if (group->stale > group->queued) {
+		group_compact(group);
+	}
+}
+
+int sched_ready(void)
+{
+	return ready_count;
+}
+
+int sched_urgent(void)
+{
+	return edf_count > 0;
+}
+
+int sched_preempts(struct TCB *tcb, struct TCB *running)
+{
+	uint64_t deadline = tcb_deadline(tcb);
+
+	if (deadline == 0)
+		return 0;
+
+	return tcb_deadline(running) == 0 || deadline < tcb_deadline(running);
+}
+
+int sched_outranked(struct TCB *tcb)
+{
+	return edf_count > 0 && sched_preempts(edf[0], tcb);
+}
+
+void sched_deadline_end(struct TCB *tcb)
+{
+	if (event_clock() > tcb->deadline)
+		deadlines_missed++;
+	else
+		deadlines_met++;
+	tcb->deadline = 0;
+}
+
+void sched_inherit(struct TCB *tcb, uint64_t deadline)
+{
+	uint64_t previous = tcb_deadline(tcb);
+
+	if (deadline != 0 && (previous == 0 || deadline < previous))
+		mutex_boosts++;
+	tcb->inherited = deadline;
+}
+
+void sched_charge(struct TCB *tcb)
+{
+	uint64_t now = event_clock();
+	uint64_t delta = now - slice_start;
+
+	slice_start = now;
+	if (tcb == NULL)
+		return;
+
+	struct uthread_group *group = tcb->group;
+
+	tcb->run_time += delta;
+	group->cpu_time += delta;
+	group->vruntime += delta * SCHED_WEIGHT_DEFAULT / group->weight;
+	if (group->heap_index != -1)
+		heap_down(group->heap_index);
+}
+
+uint64_t sched_now(void)
+{
+	return slice_start;
+}
+
+uthread_group_t uthread_group_create(unsigned int weight)
+{
+	if (weight == 0 || weight > UTHREAD_WEIGHT_MAX)
+		return NULL;
+
+	struct uthread_group *group = malloc(sizeof(struct uthread_group));
+
+	/* malloc failed */
+	if (group == NULL)
+		return NULL;
+
+	preempt_disable();
+	if (group_init(group, weight) == -1) {
+		preempt_enable();
+		free(group);
+		return NULL;
+	}
+	preempt_enable();
+
+	return group;
+}
+
+int uthread_group_destroy(uthread_group_t group)
+{
+	if (group == NULL || group == &default_group)
+		return -1;
+
+	preempt_disable();
+	if (group->threads > 0) {
+		preempt_enable();
+		return -1;
+	}
+	preempt_enable();
+
+	queue_destroy(group->ready);
+	free(group);
+
+	return 0;
+}
+
+uthread_group_t uthread_group_self(void)
+{
+	return uthread_current()->group;
+}
+
+uint64_t uthread_group_cpu_time(uthread_group_t group)
+{
+	uint64_t cpu_time;
+
+	if (group == NULL)
+		return 0;
+
+	preempt_disable();
+	cpu_time = group->cpu_time;
+	/* include the slice of the running thread */
+	if (uthread_current()->group == group)
+		cpu_time += event_clock() - slice_start;
+	preempt_enable();
+
+	return cpu_time;
+}
+
+int uthread_set_deadline(unsigned long usec)
+{
+	struct TCB *tcb = uthread_current();
+	int yield;
+
+	if (tcb == NULL)
+		return -1;
+
+	preempt_disable();
+
+	/* the previous deadline ends, met or not */
+	if (tcb->deadline != 0)
+		sched_deadline_end(tcb);
+	if (usec != 0)
+		tcb->deadline = event_clock() + (uint64_t)usec * 1000;
+
+	/* a ready thread may now have to run before this one */
+	yield = sched_outranked(tcb);
+
+	preempt_enable();
+
+	if (yield)
+		uthread_resched();
+
+	return 0;
+}
+
+int uthread_get_stats(struct uthread_stats *stats)
+{
+	if (stats == NULL)
+		return -1;
+
+	preempt_disable();
+	stats->deadlines_met = deadlines_met;
+	stats->deadlines_missed = deadlines_missed;
+	stats->mutex_boosts = mutex_boosts;
+	preempt_enable();
+
+	return 0;
+}
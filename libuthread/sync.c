@@ -0,0 +1,475 @@
+#include <limits.h>
+#include <stddef.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Mutex states */
+#define MUTEX_UNLOCKED 0
+#define MUTEX_LOCKED 1
+/* locked, and threads may be parked on the mutex */
+#define MUTEX_CONTENDED 2
+
+int uthread_mutex_init(uthread_mutex_t *mutex)
+{
+	if (mutex == NULL)
+		return -1;
+
+	*mutex = (uthread_mutex_t)UTHREAD_MUTEX_INITIALIZER;
+
+	return 0;
+}
+
+/* add a boosted mutex to the list of its owner, preemption must be disabled */
+static void mutex_link(uthread_mutex_t *mutex, struct TCB *owner)
+{
+	if (mutex->linked)
+		return;
+
+	mutex->next = owner->boosted;
+	owner->boosted = mutex;
+	mutex->linked = 1;
+}
+
+/* remove a mutex from the list of its owner, preemption must be disabled */
+static void mutex_unlink(uthread_mutex_t *mutex, struct TCB *owner)
+{
+	uthread_mutex_t **link = &owner->boosted;
+
+	if (!mutex->linked)
+		return;
+
+	while (*link != mutex)
+		link = &(*link)->next;
+	*link = mutex->next;
+	mutex->linked = 0;
+}
+
+/* earliest deadline lent to a thread by its boosted mutexes */
+static uint64_t mutex_inherited(struct TCB *owner)
+{
+	uint64_t deadline = 0;
+
+	for (uthread_mutex_t *mutex = owner->boosted; mutex != NULL;
+	     mutex = mutex->next) {
+		if (deadline == 0 || mutex->boost < deadline)
+			deadline = mutex->boost;
+	}
+
+	return deadline;
+}
+
+/*
+ * lend the deadline of a thread about to wait for @mutex to its owner, and
+ * along the chain of owners, preemption must be disabled
+ */
+static void mutex_boost(uthread_mutex_t *mutex, uint64_t deadline)
+{
+	while (mutex != NULL) {
+		struct TCB *owner = mutex->owner;
+
+		if (mutex->boost == 0 || deadline < mutex->boost)
+			mutex->boost = deadline;
+
+		/* locked by the fast path, the owner is not known yet */
+		if (owner == NULL)
+			return;
+		mutex_link(mutex, owner);
+
+		/* the chain ends at an owner which is at least as urgent */
+		if (tcb_deadline(owner) != 0 && tcb_deadline(owner) <= deadline)
+			return;
+		uthread_boost(owner, deadline);
+
+		mutex = owner->blocked_on;
+	}
+}
+
+/* the calling thread got @mutex without waiting */
+static void mutex_acquired(uthread_mutex_t *mutex)
+{
+	struct TCB *tcb = uthread_current();
+
+	mutex->owner = tcb;
+	/* a preempting waiter must see the owner if we miss its deadline */
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+	/*
+	 * A waiter arriving between the compare-and-swap and the store of the
+	 * owner lent its deadline to the mutex only: take it now.
+	 */
+	if (mutex->boost != 0) {
+		preempt_disable();
+		if (mutex->boost != 0) {
+			mutex_link(mutex, tcb);
+			sched_inherit(tcb, mutex_inherited(tcb));
+		}
+		preempt_enable();
+	}
+}
+
+int uthread_mutex_trylock(uthread_mutex_t *mutex)
+{
+	int unlocked = MUTEX_UNLOCKED;
+
+	if (mutex == NULL)
+		return -1;
+
+	if (!__atomic_compare_exchange_n(&mutex->state, &unlocked, MUTEX_LOCKED,
+					 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return -1;
+	mutex_acquired(mutex);
+
+	return 0;
+}
+
+int uthread_mutex_lock(uthread_mutex_t *mutex)
+{
+	struct TCB *tcb;
+	int state = MUTEX_UNLOCKED;
+
+	if (mutex == NULL)
+		return -1;
+
+	/* fast path, the mutex is free */
+	if (__atomic_compare_exchange_n(&mutex->state, &state, MUTEX_LOCKED,
+					0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		mutex_acquired(mutex);
+		return 0;
+	}
+
+	/*
+	 * Mark the mutex as contended, so that the owner wakes a thread up when
+	 * it unlocks, and sleep until it does. A thread taking the mutex after
+	 * sleeping keeps it contended: other threads may still be parked.
+	 */
+	tcb = uthread_current();
+	if (state != MUTEX_CONTENDED)
+		state = __atomic_exchange_n(&mutex->state, MUTEX_CONTENDED,
+					    __ATOMIC_ACQUIRE);
+
+	preempt_disable();
+	tcb->blocked_on = mutex;
+	while (state != MUTEX_UNLOCKED) {
+		/* the owner must not be kept off the CPU while we wait */
+		mutex->waiters++;
+		if (tcb_deadline(tcb) != 0)
+			mutex_boost(mutex, tcb_deadline(tcb));
+		park_wait(&mutex->state, MUTEX_CONTENDED);
+		preempt_disable();
+		mutex->waiters--;
+		state = __atomic_exchange_n(&mutex->state, MUTEX_CONTENDED,
+					    __ATOMIC_ACQUIRE);
+	}
+	tcb->blocked_on = NULL;
+	mutex->owner = tcb;
+
+	/* the deadlines of the threads still parked are now lent to us */
+	if (mutex->waiters == 0) {
+		mutex->boost = 0;
+	} else if (mutex->boost != 0) {
+		mutex_link(mutex, tcb);
+		sched_inherit(tcb, mutex_inherited(tcb));
+	}
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_mutex_unlock(uthread_mutex_t *mutex)
+{
+	struct TCB *tcb;
+	int yield;
+
+	if (mutex == NULL)
+		return -1;
+
+	/* from now on, waiters do not lend us their deadline */
+	mutex->owner = NULL;
+
+	/* fast path, nobody lent us a deadline through the mutex */
+	if (mutex->boost == 0) {
+		if (__atomic_exchange_n(&mutex->state, MUTEX_UNLOCKED,
+					__ATOMIC_RELEASE) == MUTEX_CONTENDED)
+			uthread_unpark(&mutex->state, 1);
+		return 0;
+	}
+
+	/* give the deadline back, the next owner inherits it if it waited */
+	tcb = uthread_current();
+	preempt_disable();
+	mutex_unlink(mutex, tcb);
+	sched_inherit(tcb, mutex_inherited(tcb));
+	if (mutex->waiters == 0)
+		mutex->boost = 0;
+	if (__atomic_exchange_n(&mutex->state, MUTEX_UNLOCKED,
+				__ATOMIC_RELEASE) == MUTEX_CONTENDED)
+		park_wake(&mutex->state, 1);
+	yield = sched_outranked(tcb);
+	preempt_enable();
+
+	if (yield)
+		uthread_resched();
+
+	return 0;
+}
+
+int uthread_cond_init(uthread_cond_t *cond)
+{
+	if (cond == NULL)
+		return -1;
+
+	cond->seq = 0;
+
+	return 0;
+}
+
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex)
+{
+	int seq;
+
+	if (cond == NULL || mutex == NULL)
+		return -1;
+
+	uthread_testcancel();
+
+	/* a signal sent after the mutex is released changes the sequence */
+	seq = __atomic_load_n(&cond->seq, __ATOMIC_RELAXED);
+	uthread_mutex_unlock(mutex);
+
+	preempt_disable();
+	park_wait(&cond->seq, seq);
+
+	/* a cancelled thread exits holding the mutex, like after a wakeup */
+	uthread_mutex_lock(mutex);
+	uthread_testcancel();
+
+	return 0;
+}
+
+int uthread_cond_signal(uthread_cond_t *cond)
+{
+	if (cond == NULL)
+		return -1;
+
+	__atomic_add_fetch(&cond->seq, 1, __ATOMIC_RELEASE);
+	uthread_unpark(&cond->seq, 1);
+
+	return 0;
+}
+
+int uthread_cond_broadcast(uthread_cond_t *cond)
+{
+	if (cond == NULL)
+		return -1;
+
+	__atomic_add_fetch(&cond->seq, 1, __ATOMIC_RELEASE);
+	uthread_unpark(&cond->seq, INT_MAX);
+
+	return 0;
+}
+
+int uthread_rwlock_init(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+		return -1;
+
+	*rwlock = (uthread_rwlock_t)UTHREAD_RWLOCK_INITIALIZER;
+
+	return 0;
+}
+
+/* whether a reader may enter, preemption must be disabled */
+static int rwlock_readable(uthread_rwlock_t *rwlock)
+{
+	/* waiting writers go first */
+	return !rwlock->writer && rwlock->writers_waiting == 0;
+}
+
+int uthread_rwlock_rdlock(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+		return -1;
+
+	preempt_disable();
+	while (!rwlock_readable(rwlock)) {
+		rwlock->readers_waiting++;
+		park_wait(&rwlock->readers_seq, rwlock->readers_seq);
+		preempt_disable();
+		rwlock->readers_waiting--;
+	}
+	rwlock->readers++;
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_rwlock_tryrdlock(uthread_rwlock_t *rwlock)
+{
+	int ret = -1;
+
+	if (rwlock == NULL)
+		return -1;
+
+	preempt_disable();
+	if (rwlock_readable(rwlock)) {
+		rwlock->readers++;
+		ret = 0;
+	}
+	preempt_enable();
+
+	return ret;
+}
+
+int uthread_rwlock_wrlock(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+		return -1;
+
+	preempt_disable();
+	rwlock->writers_waiting++;
+	while (rwlock->writer || rwlock->readers > 0) {
+		park_wait(&rwlock->writers_seq, rwlock->writers_seq);
+		preempt_disable();
+	}
+	rwlock->writers_waiting--;
+	rwlock->writer = 1;
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_rwlock_trywrlock(uthread_rwlock_t *rwlock)
+{
+	int ret = -1;
+
+	if (rwlock == NULL)
+		return -1;
+
+	preempt_disable();
+	if (!rwlock->writer && rwlock->readers == 0) {
+		rwlock->writer = 1;
+		ret = 0;
+	}
+	preempt_enable();
+
+	return ret;
+}
+
+int uthread_rwlock_unlock(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+		return -1;
+
+	preempt_disable();
+
+	if (rwlock->writer)
+		rwlock->writer = 0;
+	else
+		rwlock->readers--;
+
+	if (rwlock->readers == 0 && rwlock->writers_waiting > 0) {
+		/* the lock goes to the next writer */
+		rwlock->writers_seq++;
+		park_wake(&rwlock->writers_seq, 1);
+	} else if (rwlock->writers_waiting == 0 && rwlock->readers_waiting > 0) {
+		/* all the readers enter together */
+		rwlock->readers_seq++;
+		park_wake(&rwlock->readers_seq, INT_MAX);
+	}
+
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_barrier_init(uthread_barrier_t *barrier, int count)
+{
+	if (barrier == NULL || count <= 0)
+		return -1;
+
+	barrier->count = count;
+	barrier->waiting = 0;
+	barrier->seq = 0;
+
+	return 0;
+}
+
+int uthread_barrier_wait(uthread_barrier_t *barrier)
+{
+	int seq;
+
+	if (barrier == NULL)
+		return -1;
+
+	preempt_disable();
+
+	/* the last thread to arrive releases the others, in one pass */
+	seq = barrier->seq;
+	if (++barrier->waiting == barrier->count) {
+		barrier->waiting = 0;
+		barrier->seq++;
+		park_wake(&barrier->seq, INT_MAX);
+		preempt_enable();
+		return UTHREAD_BARRIER_SERIAL_THREAD;
+	}
+
+	/* the barrier may be reused at once, wait for our own phase to end */
+	while (barrier->seq == seq) {
+		park_wait(&barrier->seq, seq);
+		preempt_disable();
+	}
+	preempt_enable();
+
+	return 0;
+}
+
+/* Once states */
+#define ONCE_INIT 0
+#define ONCE_RUNNING 1
+#define ONCE_DONE 2
+
+/* cleanup handler of a cancelled initialization, another thread runs it */
+static void once_cancel(void *arg)
+{
+	uthread_once_t *once = arg;
+
+	__atomic_store_n(&once->state, ONCE_INIT, __ATOMIC_RELEASE);
+	uthread_unpark(&once->state, 1);
+}
+
+int uthread_once(uthread_once_t *once, void (*init)(void))
+{
+	int state = ONCE_INIT;
+
+	if (once == NULL || init == NULL)
+		return -1;
+
+	/* fast path, the initialization is over */
+	if (__atomic_load_n(&once->state, __ATOMIC_ACQUIRE) == ONCE_DONE)
+		return 0;
+
+	while (!__atomic_compare_exchange_n(&once->state, &state, ONCE_RUNNING,
+					    0, __ATOMIC_ACQUIRE,
+					    __ATOMIC_ACQUIRE)) {
+		if (state == ONCE_DONE)
+			return 0;
+
+		/* another thread runs @init */
+		preempt_disable();
+		park_wait(&once->state, ONCE_RUNNING);
+		state = ONCE_INIT;
+	}
+
+	if (uthread_cleanup_push(once_cancel, once) == 0) {
+		init();
+		uthread_cleanup_pop(0);
+	} else {
+		init();
+	}
+
+	__atomic_store_n(&once->state, ONCE_DONE, __ATOMIC_RELEASE);
+	uthread_unpark(&once->state, INT_MAX);
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Number of keys stored in the spillover array of a TCB */
+#define TLS_SPILL (UTHREAD_KEYS_MAX - UTHREAD_TLS_INLINE)
+
+/* Number of passes over the destructors when a thread exits */
+#define TLS_DESTRUCTOR_ITERATIONS 4
+
+struct key {
+	int used;
+	void (*destructor)(void*);
+};
+
+static struct key keys[UTHREAD_KEYS_MAX];
+
+/* number of keys created so far, keys are never reused */
+static unsigned int key_count;
+
+/* address of the value of @key in @tcb, NULL if it was never stored */
+static void **tls_slot(struct TCB *tcb, uthread_key_t key)
+{
+	if (key < UTHREAD_TLS_INLINE)
+		return &tcb->tls[key];
+
+	if (tcb->tls_spill == NULL)
+		return NULL;
+
+	return &tcb->tls_spill[key - UTHREAD_TLS_INLINE];
+}
+
+void uthread_tls_init(struct TCB *tcb)
+{
+	for (int i = 0; i < UTHREAD_TLS_INLINE; i++)
+		tcb->tls[i] = NULL;
+	tcb->tls_spill = NULL;
+}
+
+void uthread_tls_exit(struct TCB *tcb)
+{
+	int iteration, found = 1;
+	uthread_key_t key;
+
+	/* destructors may set values again, go over the keys a few times */
+	for (iteration = 0; iteration < TLS_DESTRUCTOR_ITERATIONS && found;
+	     iteration++) {
+		found = 0;
+		for (key = 0; key < key_count; key++) {
+			void **slot = tls_slot(tcb, key);
+
+			if (slot == NULL || *slot == NULL)
+				continue;
+
+			void *value = *slot;
+			*slot = NULL;
+			if (keys[key].used && keys[key].destructor != NULL) {
+				keys[key].destructor(value);
+				found = 1;
+			}
+		}
+	}
+
+	free(tcb->tls_spill);
+	tcb->tls_spill = NULL;
+}
+
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void*))
+{
+	if (key == NULL)
+		return -1;
+
+	preempt_disable();
+
+	if (key_count == UTHREAD_KEYS_MAX) {
+		preempt_enable();
+		return -1;
+	}
+
+	keys[key_count].used = 1;
+	keys[key_count].destructor = destructor;
+	*key = key_count;
+	key_count++;
+
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_key_delete(uthread_key_t key)
+{
+	if (key >= key_count || !keys[key].used)
+		return -1;
+
+	keys[key].used = 0;
+
+	return 0;
+}
+
+void *uthread_getspecific(uthread_key_t key)
+{
+	struct TCB *tcb = uthread_current();
+
+	/* fast path, a single load from the TCB */
+	if (key < UTHREAD_TLS_INLINE)
+		return tcb->tls[key];
+
+	if (key >= key_count || !keys[key].used)
+		return NULL;
+
+	void **slot = tls_slot(tcb, key);
+
+	return slot == NULL ? NULL : *slot;
+}
+
+int uthread_setspecific(uthread_key_t key, void *value)
+{
+	struct TCB *tcb = uthread_current();
+
+	if (key >= key_count || !keys[key].used)
+		return -1;
+
+	if (key >= UTHREAD_TLS_INLINE && tcb->tls_spill == NULL) {
+		/* storing NULL does not need the spillover array */
+		if (value == NULL)
+			return 0;
+
+		tcb->tls_spill = calloc(TLS_SPILL, sizeof(void*));
+		if (tcb->tls_spill == NULL)
+			return -1;
+	}
+
+	*tls_slot(tcb, key) = value;
+
+	return 0;
+}
@@ -1,11 +1,9 @@
 #include <assert.h>
 #include <limits.h>
-#include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
 
 #include "private.h"
 #include "uthread.h"
@@ -13,48 +11,300 @@
 #include "queue.h"
 #include "context.c"
 
-#define Running 0
-#define Ready 1
-#define Blocked 2
-#define Zombie 3
-
-struct TCB{
-	uthread_t TID;
-	uthread_ctx_t context;
-	int state;
-	void* stack;
-	int retval;
-};
-
 /* stores current running TCB */
 struct TCB* current_thread;
 
-/* stores active and zombie threads TCB*/
-static queue_t ready_queue, zombie_queue;
+/* next TID to try, TIDs increase until they wrap around to the free ones */
+static int next_tid = 1;
+
+/* A thread waiting for one or several threads to exit, parked on @remaining */
+struct join_wait {
+	/* number of exits still needed before waking the thread */
+	int remaining;
+	/* index of the first thread which exited */
+	int first;
+};
+
+/* Initial and maximum size of the thread table, one slot per TID */
+#define TABLE_SIZE 64
+#define TABLE_MAX (USHRT_MAX + 1)
+
+/* A handle is the generation of a slot above the TID of the slot */
+#define HANDLE_TID_BITS 16
+
+/*
+ * A slot of the thread table. Its generation changes each time its thread is
+ * reclaimed, so that the handles of the previous threads become stale.
+ */
+struct table_slot {
+	struct TCB *tcb;
+	uint64_t generation;
+};
+
+/* threads which were not reclaimed yet, indexed by TID */
+static struct table_slot *thread_table;
+static int table_size;
+/* number of threads in the table, apart from the main thread */
+static int thread_live;
+
+/* find a free TID, 0 is reserved to the main thread */
+static int table_alloc(void)
+{
+	for (int i = 1; i < TABLE_MAX; i++) {
+		int tid = next_tid;
+
+		next_tid = next_tid == TABLE_MAX - 1 ? 1 : next_tid + 1;
+		if (tid >= table_size || thread_table[tid].tcb == NULL)
+			return tid;
+	}
+
+	/* every TID belongs to a thread which was not reclaimed yet */
+	return -1;
+}
+
+/* register a new thread in the thread table */
+static int table_insert(struct TCB *tcb)
+{
+	if (tcb->TID >= table_size) {
+		int size = table_size ? table_size : TABLE_SIZE;
+
+		while (size <= tcb->TID)
+			size *= 2;
+
+		struct table_slot *table = realloc(thread_table,
+						   size * sizeof(struct table_slot));
+
+		/* malloc failed */
+		if (table == NULL)
+			return -1;
+
+		/* generations start at 1, so that no handle is 0 */
+		for (int i = table_size; i < size; i++) {
+			table[i].tcb = NULL;
+			table[i].generation = 1;
+		}
+		thread_table = table;
+		table_size = size;
+	}
+
+	thread_table[tcb->TID].tcb = tcb;
+	if (tcb->TID != 0)
+		thread_live++;
+
+	return 0;
+}
+
+/* find a thread which was not reclaimed yet */
+static struct TCB *table_find(uthread_t tid)
+{
+	if (tid >= table_size)
+		return NULL;
+
+	return thread_table[tid].tcb;
+}
+
+/* handle of a thread which was not reclaimed yet */
+static uthread_handle_t table_handle(struct TCB *tcb)
+{
+	return thread_table[tcb->TID].generation << HANDLE_TID_BITS | tcb->TID;
+}
+
+/* find the thread of a handle, NULL if it was reclaimed since */
+static struct TCB *handle_find(uthread_handle_t handle)
+{
+	uthread_t tid = handle & (TABLE_MAX - 1);
+	struct TCB *tcb = table_find(tid);
+
+	if (tcb == NULL ||
+	    thread_table[tid].generation != handle >> HANDLE_TID_BITS)
+		return NULL;
 
-/* count the number of threads so I can provide unique TID*/
-static int thread_count = 0;
+	return tcb;
+}
+
+/* thread which exited and whose stack can be freed once left */
+static struct TCB *reap_thread;
+
+/* free the TCB and the stack of a thread which exited */
+static void reclaim(struct TCB *tcb)
+{
+	if (tcb == reap_thread)
+		reap_thread = NULL;
+
+	/* the TID can be reused, but not the handle */
+	thread_table[tcb->TID].tcb = NULL;
+	thread_table[tcb->TID].generation++;
+	thread_live--;
+	uthread_ctx_destroy_stack(tcb->stack);
+	free(tcb);
+}
+
+/*
+ * free the stack of the last exited thread, we are no longer running on it.
+ * Detached threads are freed entirely, the others stay zombies until joined.
+ */
+static void reap(void)
+{
+	struct TCB *tcb = reap_thread;
+
+	if (tcb == NULL)
+		return;
+
+	reap_thread = NULL;
+	if (tcb->detached) {
+		reclaim(tcb);
+	} else {
+		uthread_ctx_destroy_stack(tcb->stack);
+		tcb->stack = NULL;
+	}
+}
+
+/* initialize the fields common to every new TCB */
+static void tcb_init(struct TCB *tcb, struct TCB *parent)
+{
+	tcb->arg = NULL;
+	tcb->detached = 0;
+	tcb->join_wait = NULL;
+	tcb->cancel_pending = 0;
+	tcb->exiting = 0;
+	tcb->cleanup = NULL;
+	tcb->timer_index = -1;
+	tcb->remote_waiting = 0;
+	tcb->remote_token = 0;
+	uthread_tls_init(tcb);
+	uthread_arena_init(tcb);
+
+	/* the new thread is the first child of its parent */
+	tcb->parent = parent;
+	tcb->children = NULL;
+	tcb->sibling_prev = NULL;
+	tcb->sibling_next = NULL;
+	if (parent != NULL) {
+		tcb->sibling_next = parent->children;
+		if (parent->children != NULL)
+			parent->children->sibling_prev = tcb;
+		parent->children = tcb;
+	}
+}
+
+/* remove an exiting thread from the thread tree */
+static void tcb_unlink(struct TCB *tcb)
+{
+	struct TCB *child;
+
+	if (tcb->parent != NULL) {
+		if (tcb->sibling_prev == NULL)
+			tcb->parent->children = tcb->sibling_next;
+		else
+			tcb->sibling_prev->sibling_next = tcb->sibling_next;
+		if (tcb->sibling_next != NULL)
+			tcb->sibling_next->sibling_prev = tcb->sibling_prev;
+		tcb->parent = NULL;
+	}
+
+	/* children outlive their parent as roots of their own trees */
+	for (child = tcb->children; child != NULL; child = child->sibling_next)
+		child->parent = NULL;
+	tcb->children = NULL;
+}
+
+/*
+ * Number of times in a row the run-next slot may be preferred over the ready
+ * queue, so that threads waking each other cannot starve the queue
+ */
+#define RUN_NEXT_MAX 16
+
+/* most recently woken thread, runs before the ready queue */
+static struct TCB *run_next;
+static int run_next_streak;
+
+/* put the run-next thread back in the ready queue, in FIFO order */
+static void flush_run_next(void)
+{
+	if (run_next == NULL)
+		return;
+
+	sched_enqueue(run_next);
+	run_next = NULL;
+}
+
+/* dequeue the next thread to run, there must always be one */
+static struct TCB *next_thread(void)
+{
+	struct TCB *tcb;
+
+	/* the CPU time of the leaving thread goes to its group */
+	sched_charge(current_thread);
+
+	/* wake up the threads whose timer expired or whose fd is ready */
+	event_poll(0);
+
+	/* nothing can run, sleep until an event wakes a thread up */
+	if (run_next == NULL && sched_ready() == 0) {
+		do {
+			if (event_poll(1) == -1) {
+				fprintf(stderr, "uthread: deadlock, no runnable thread\n");
+				exit(1);
+			}
+		} while (run_next == NULL && sched_ready() == 0);
+
+		/* idle time is charged to nobody */
+		sched_charge(NULL);
+	}
+
+	/* threads with a deadline are not delayed by the run-next slot */
+	if (run_next != NULL && !sched_urgent() &&
+	    (run_next_streak < RUN_NEXT_MAX || sched_ready() == 0)) {
+		tcb = run_next;
+		run_next = NULL;
+		run_next_streak++;
+	} else {
+		tcb = sched_dequeue();
+		run_next_streak = 0;
+	}
+	tcb->state = Running;
+
+	/* the state published for uthread_top shows the thread about to run */
+	monitor_poll();
+
+	return tcb;
+}
 
 
 int uthread_start(int preempt)
 {
+#ifdef UTHREAD_COOP
+	/* the cooperative-only build cannot preempt threads */
+	if (preempt == 1)
+		return -1;
+#endif
+
 	if (preempt == 1)
 		preempt_start();
 
-	/* create queue for threads*/
-	ready_queue = queue_create();
-	zombie_queue = queue_create();
+	/* create the ready queues of the scheduler */
+	if (sched_start() == -1)
+		return -1;
 
 	/* create main thread */
 	struct TCB *uthread_tcb = malloc(sizeof(struct TCB));
 
 	/* malloc faliure */
-	if (ready_queue == NULL || zombie_queue == NULL || uthread_tcb == NULL)
+	if (uthread_tcb == NULL)
+		return -1;
+
+	if (event_start() == -1)
 		return -1;
 
 	/* main thread TID is 0 */
-	uthread_tcb->TID = thread_count;
-	uthread_tcb->state = Ready;
+	uthread_tcb->TID = 0;
+	uthread_tcb->state = Running;
+	uthread_tcb->stack = NULL;
+	tcb_init(uthread_tcb, NULL);
+	sched_attach(uthread_tcb, NULL);
+
+	if (table_insert(uthread_tcb) == -1)
+		return -1;
 
 	/* set current thread as main thread */
 	current_thread = uthread_tcb;
@@ -69,89 +319,320 @@ int uthread_stop(void)
 		return -1;
 	
 	struct TCB *tcb;
+	uthread_t *tids = NULL;
+	int n;
 
-	/* if there is still active threads in ready queue
-	 * the main thread will join them */
-	while (queue_length(ready_queue) > 0) {
-		queue_dequeue(ready_queue, (void**)&tcb);
+	/* the main thread joins every thread which is still alive */
+	while (thread_live > 0) {
+		uthread_t *grown = realloc(tids, thread_live * sizeof(uthread_t));
 
-		/* we don't need to join main thread*/
-		if (tcb->TID == 0) {
-			queue_enqueue(ready_queue, tcb);
-			continue;
+		/* malloc failed */
+		if (grown == NULL) {
+			free(tids);
+			return -1;
 		}
+		tids = grown;
 
-		/* put the thread back so yield could let it run */
-		queue_enqueue(ready_queue, tcb);
-		uthread_join(tcb->TID, NULL);
-	}
+		n = 0;
+		for (int tid = 1; tid < table_size; tid++) {
+			tcb = thread_table[tid].tcb;
+			if (tcb != NULL && !tcb->detached && tcb->join_wait == NULL)
+				tids[n++] = tid;
+		}
 
-	/* free ready and zombie queues and anything in the queue */
-	while (queue_length(ready_queue) > 0) {
-		queue_dequeue(ready_queue, (void**)&tcb);
-		free(tcb);
-		free(tcb->stack);
+		/* a single wait for all of them, threads may create new ones */
+		if (n > 0)
+			uthread_join_all(tids, n, NULL);
+		else if (thread_live > 0)
+			/* detached threads cannot be joined, let them finish */
+			uthread_yield();
 	}
-	while (queue_length(zombie_queue) > 0) {
-		queue_dequeue(zombie_queue, (void**)&tcb);
-		free(tcb);
-		free(tcb->stack);
-	}
-	queue_destroy(ready_queue);
-	queue_destroy(zombie_queue);
+	free(tids);
+
+	reap();
+
+	/* every thread exited, the ready queues are empty */
+	sched_stop();
+	uthread_ctx_release_stacks();
+
+	preempt_disable();
+	uthread_arena_exit(current_thread);
+	preempt_enable();
+	uthread_arena_release();
 
 	/*free the main thread TCB */
+	free(current_thread->tls_spill);
 	free(current_thread);
+	free(thread_table);
+	thread_table = NULL;
+	table_size = 0;
 
+	uthread_monitor_stop();
+	offload_stop();
+	remote_stop();
+	affinity_stop();
+	event_stop();
 	preempt_stop();
 	return 0;
 }
 
-int uthread_create(uthread_func_t func)
+/*
+ * create a thread child of @parent (if not NULL) in @group (the default group
+ * if NULL), preemption must be disabled
+ */
+static struct TCB *spawn_locked(uthread_func_t func, void *arg, int detached,
+				struct TCB *parent, struct uthread_group *group)
 {
 	/* malloc a new TCB for new thread */
 	struct TCB *uthread_tcb = malloc(sizeof(struct TCB));
 
-	/* malloc and change type to char* */
-    uthread_tcb->stack = (char*)uthread_ctx_alloc_stack();
+	if (uthread_tcb == NULL)
+		return NULL;
+
+	uthread_tcb->stack = uthread_ctx_alloc_stack();
+	if (uthread_tcb->stack == NULL) {
+		free(uthread_tcb);
+		return NULL;
+	}
+
+	/* every TID is taken */
+	int tid = table_alloc();
+	if (tid == -1) {
+		uthread_ctx_destroy_stack(uthread_tcb->stack);
+		free(uthread_tcb);
+		return NULL;
+	}
+
+	/* initialize the tcb */
+	int initial_status = uthread_ctx_init(&(uthread_tcb->context), uthread_tcb->stack, func);
+	/* initialize faliure */
+	if (initial_status == -1) {
+		uthread_ctx_destroy_stack(uthread_tcb->stack);
+		free(uthread_tcb);
+		return NULL;
+	}
+	/* set TID and state */
+	uthread_tcb->TID = tid;
+	uthread_tcb->state = Ready;
+
+	if (table_insert(uthread_tcb) == -1) {
+		uthread_ctx_destroy_stack(uthread_tcb->stack);
+		free(uthread_tcb);
+		return NULL;
+	}
+
+	tcb_init(uthread_tcb, parent);
+	uthread_tcb->arg = arg;
+	uthread_tcb->detached = detached;
+	sched_attach(uthread_tcb, group);
 
-    /* protect the thread when creating new TCB */
-    preempt_disable();
+	/* put the thread into ready queue*/
+	sched_enqueue(uthread_tcb);
 
-    /* initialize the tcb */
-    int initial_status = uthread_ctx_init(&(uthread_tcb->context), uthread_tcb->stack, func);
-    /* initialize faliure */
-    if (initial_status == -1)
+	return uthread_tcb;
+}
+
+/*
+ * create a thread in @group, or in the group of the current thread if NULL,
+ * and store its handle in @handle if not NULL
+ */
+static struct TCB *spawn(uthread_func_t func, void *arg, int detached,
+			 struct uthread_group *group, uthread_handle_t *handle)
+{
+	struct TCB *uthread_tcb;
+
+	/* protect the thread when creating new TCB */
+	preempt_disable();
+
+	/* a detached thread may be waiting to be freed, its stack reused */
+	reap();
+
+	/* threads stay in the group of the thread which created them */
+	uthread_tcb = spawn_locked(func, arg, detached, current_thread,
+				   group ? group : current_thread->group);
+
+	/* the thread may be reclaimed as soon as preemption is enabled */
+	if (uthread_tcb != NULL && handle != NULL)
+		*handle = table_handle(uthread_tcb);
+
+	preempt_enable();
+
+	return uthread_tcb;
+}
+
+struct TCB *uthread_spawn(uthread_func_t func, void *arg, int detached)
+{
+	return spawn(func, arg, detached, NULL, NULL);
+}
+
+struct TCB *uthread_spawn_orphan(uthread_func_t func, void *arg)
+{
+	/* the current thread may be exiting, it cannot be the parent */
+	return spawn_locked(func, arg, 1, NULL, NULL);
+}
+
+struct TCB *uthread_find(uthread_handle_t handle)
+{
+	return handle_find(handle);
+}
+
+int uthread_create(uthread_func_t func)
+{
+	struct TCB *uthread_tcb = uthread_spawn(func, NULL, 0);
+
+	if (uthread_tcb == NULL)
 		return -1;
-    /* set TID and state */
-    thread_count++;
-    uthread_tcb->TID = thread_count;
-    uthread_tcb->state = Ready;
 
-    /* put the thread into ready queue*/
-    queue_enqueue(ready_queue, uthread_tcb);
+	return uthread_tcb->TID;
+}
+
+int uthread_create_group(uthread_group_t group, uthread_func_t func)
+{
+	if (group == NULL)
+		return -1;
 
-    preempt_enable();
+	struct TCB *uthread_tcb = spawn(func, NULL, 0, group, NULL);
 
-    return uthread_tcb->TID;
+	if (uthread_tcb == NULL)
+		return -1;
+
+	return uthread_tcb->TID;
 }
 
-void uthread_yield(void)
+uthread_handle_t uthread_create_handle(uthread_func_t func)
+{
+	uthread_handle_t handle;
+
+	if (spawn(func, NULL, 0, NULL, &handle) == NULL)
+		return UTHREAD_HANDLE_INVALID;
+
+	return handle;
+}
+
+void uthread_resched(void)
 {
 	/* protect the thread when switch to new thread*/
 	preempt_disable();
 
 	/* yield thread will yield */
 	struct TCB *yield_thread = current_thread;
+	yield_thread->state = Ready;
 
 	/* yield thread will go to the end of ready queue */
-	queue_enqueue(ready_queue, yield_thread);
+	sched_enqueue(yield_thread);
 
 	/* next avaliable thread becomes current thread */
-	queue_dequeue(ready_queue, (void**)&current_thread);
+	current_thread = next_thread();
 
 	/*switch context*/
 	uthread_ctx_switch(&(yield_thread->context), &(current_thread->context));
+
+	/* back to the yield thread */
+	reap();
+	preempt_enable();
+}
+
+void uthread_yield(void)
+{
+	uthread_testcancel();
+	uthread_resched();
+	uthread_testcancel();
+}
+
+struct TCB *uthread_current(void)
+{
+	return current_thread;
+}
+
+void uthread_block(void)
+{
+	preempt_disable();
+
+	struct TCB *blocked_thread = current_thread;
+	blocked_thread->state = Blocked;
+
+	/* the blocked thread stays out of the ready queue until unblocked */
+	current_thread = next_thread();
+	uthread_ctx_switch(&(blocked_thread->context), &(current_thread->context));
+
+	reap();
+	preempt_enable();
+}
+
+void uthread_unblock(struct TCB *tcb)
+{
+	/* already woken up, e.g. by a cancellation */
+	if (tcb->state != Blocked)
+		return;
+
+	tcb->state = Ready;
+
+	/* a thread with an earlier deadline takes the CPU at once */
+	if (tcb_deadline(tcb) != 0) {
+		sched_enqueue(tcb);
+		if (sched_preempts(tcb, current_thread))
+			preempt_resched();
+		return;
+	}
+
+	/* the woken thread runs next, its data is still hot in cache */
+	flush_run_next();
+	run_next = tcb;
+}
+
+void uthread_unblock_batch(struct TCB **tcbs, int n)
+{
+	int ready = 0, resched = 0;
+
+	for (int i = 0; i < n; i++) {
+		/* already woken up, e.g. by a cancellation */
+		if (tcbs[i]->state != Blocked)
+			continue;
+
+		tcbs[i]->state = Ready;
+		if (tcb_deadline(tcbs[i]) != 0 &&
+		    sched_preempts(tcbs[i], current_thread))
+			resched = 1;
+		tcbs[ready++] = tcbs[i];
+	}
+
+	sched_enqueue_batch(tcbs, ready);
+
+	/* a thread with an earlier deadline takes the CPU at once */
+	if (resched)
+		preempt_resched();
+}
+
+void uthread_boost(struct TCB *tcb, uint64_t deadline)
+{
+	int ready = tcb->state == Ready;
+
+	/* a ready thread is queued by the deadline it was scheduled by */
+	if (ready) {
+		if (tcb == run_next)
+			run_next = NULL;
+		else
+			sched_remove(tcb);
+	}
+
+	sched_inherit(tcb, deadline);
+
+	if (ready) {
+		sched_enqueue(tcb);
+		if (sched_preempts(tcb, current_thread))
+			preempt_resched();
+	}
+}
+
+void uthread_walk(void (*fn)(struct TCB *tcb, uthread_handle_t handle,
+			     void *arg), void *arg)
+{
+	for (int tid = 0; tid < table_size; tid++) {
+		struct TCB *tcb = thread_table[tid].tcb;
+
+		if (tcb != NULL)
+			fn(tcb, table_handle(tcb), arg);
+	}
 }
 
 uthread_t uthread_self(void)
@@ -159,73 +640,419 @@ uthread_t uthread_self(void)
 	return current_thread->TID;
 }
 
+uthread_handle_t uthread_self_handle(void)
+{
+	return table_handle(current_thread);
+}
+
+uthread_handle_t uthread_handle(uthread_t tid)
+{
+	uthread_handle_t handle = UTHREAD_HANDLE_INVALID;
+
+	preempt_disable();
+	struct TCB *tcb = table_find(tid);
+	if (tcb != NULL)
+		handle = table_handle(tcb);
+	preempt_enable();
+
+	return handle;
+}
+
+int uthread_handle_tid(uthread_handle_t handle)
+{
+	int tid = -1;
+
+	preempt_disable();
+	struct TCB *tcb = handle_find(handle);
+	if (tcb != NULL)
+		tid = tcb->TID;
+	preempt_enable();
+
+	return tid;
+}
+
+/* an exiting thread has a joiner, preemption must be disabled */
+static void join_complete(struct TCB *tcb)
+{
+	struct join_wait *wait = tcb->join_wait;
+
+	if (wait->first == -1)
+		wait->first = tcb->join_index;
+	if (--wait->remaining == 0)
+		park_wake(&wait->remaining, 1);
+}
+
 void uthread_exit(int retval)
 {
+	struct uthread_cleanup *cleanup;
+
+	/* cancellation points reached from now on do not cancel again */
+	current_thread->exiting = 1;
+
+	/* cleanup handlers run from the last pushed to the first */
+	while ((cleanup = current_thread->cleanup) != NULL) {
+		current_thread->cleanup = cleanup->next;
+		cleanup->routine(cleanup->arg);
+		free(cleanup);
+	}
+
+	/* destructors run in the exiting thread, before it leaves the CPU */
+	uthread_tls_exit(current_thread);
+
 	/* protect the thread when a thread is ready to finish */
 	preempt_disable();
 
+	/* memory of the arena dies with the thread */
+	uthread_arena_exit(current_thread);
+	if (current_thread->deadline != 0)
+		sched_deadline_end(current_thread);
+	sched_detach(current_thread);
+
 	struct TCB *zombie_thread = current_thread;
-	/* get next available thread from queue as new current thread */
-	queue_dequeue(ready_queue, (void**)&current_thread);
 	/* change the status to zombie*/
 	zombie_thread->state = Zombie;
 	/* stores the return value in the TCB so parent could access to it */ 
 	zombie_thread->retval = retval;
-	/* put zombie_thread into zombie_queue so parent knows it finished */
-	queue_enqueue(zombie_queue, zombie_thread);
+	tcb_unlink(zombie_thread);
+	/* a zombie does not need its stack, free it as soon as we left it */
+	reap();
+	reap_thread = zombie_thread;
+	/* the joining thread can collect the return value */
+	if (zombie_thread->join_wait != NULL)
+		join_complete(zombie_thread);
+	/* get next available thread from queue as new current thread */
+	current_thread = next_thread();
 	uthread_ctx_switch(&(zombie_thread->context), &(current_thread->context));
 
 }
 
 
-static int find_by_tid(queue_t q, void *data, void *arg)
+/* find a ready thread, either in the run-next slot or in the ready queue */
+static struct TCB *find_ready(uthread_t tid)
 {
-	/* this instruction will basically do nothing
-	 * q has no use here and it just avoids the usused variable warning
-	 */
-	if (queue_length(q) == 0)
-		return 0;
+	struct TCB *tcb = table_find(tid);
 
-	int tid = *((int*)arg);
+	if (tcb == NULL || tcb->state != Ready)
+		return NULL;
 
-	/* if find the TID, return true */
-	return ((struct TCB*)data)->TID == tid;
+	return tcb;
 }
 
+int uthread_yield_to(uthread_t tid)
+{
+	preempt_disable();
+
+	struct TCB *target = find_ready(tid);
+
+	if (target == NULL || target == current_thread) {
+		preempt_enable();
+		return -1;
+	}
+
+	/* take the target out of the scheduling order */
+	if (target == run_next)
+		run_next = NULL;
+	else
+		sched_remove(target);
+
+	struct TCB *yield_thread = current_thread;
+	yield_thread->state = Ready;
+	sched_charge(yield_thread);
+	sched_enqueue(yield_thread);
+
+	current_thread = target;
+	current_thread->state = Running;
+	uthread_ctx_switch(&(yield_thread->context), &(current_thread->context));
+
+	reap();
+	preempt_enable();
+
+	return 0;
+}
+
+/*
+ * register the current thread as the joiner of @n threads, which must still
+ * have the handle @handle if it is not UTHREAD_HANDLE_INVALID (then @n is 1)
+ *
+ * Return: -1 if a thread cannot be joined by the current thread, the number of
+ * threads which already exited otherwise.
+ */
+static int join_register(struct join_wait *wait, uthread_t *tids, int n,
+			 uthread_handle_t handle)
+{
+	struct TCB *tcb;
+	int i, exited = 0;
+
+	for (i = 0; i < n; i++) {
+		tcb = table_find(tids[i]);
+
+		/* main thread and a thread itself cannot be joined, nor a thread
+		 * joined by another thread (or twice in the set) */
+		if (tids[i] == 0 || tcb == NULL || tcb == current_thread ||
+		    tcb->detached || tcb->join_wait != NULL)
+			break;
+
+		/* the TID now belongs to another thread */
+		if (handle != UTHREAD_HANDLE_INVALID && handle_find(handle) != tcb)
+			break;
+
+		tcb->join_wait = wait;
+		tcb->join_index = i;
+		if (tcb->state == Zombie) {
+			if (wait->first == -1)
+				wait->first = i;
+			exited++;
+		}
+	}
+
+	if (i == n)
+		return exited;
+
+	/* undo the registrations made before the invalid thread */
+	while (i-- > 0)
+		table_find(tids[i])->join_wait = NULL;
+
+	return -1;
+}
+
+/* unregister the joiner of @n threads, preemption must be disabled */
+static void join_unregister(uthread_t *tids, int n)
+{
+	for (int i = 0; i < n; i++)
+		table_find(tids[i])->join_wait = NULL;
+}
+
+/* collect a zombie thread, preemption must be disabled */
+static int join_collect(uthread_t tid)
+{
+	struct TCB *tcb = table_find(tid);
+	int retval = tcb->retval;
+
+	/* the child thread is collected, its resources can be freed */
+	reclaim(tcb);
+
+	return retval;
+}
+
+/*
+ * wait until @needed of @n threads exited, see join_register() for @handle
+ *
+ * Return: -1 if a thread cannot be joined, the index of the first thread
+ * which exited otherwise. Returns with preemption disabled on success.
+ */
+static int join_threads(uthread_t *tids, int n, int needed,
+			uthread_handle_t handle)
+{
+	struct join_wait wait;
+	int exited;
+
+	if (tids == NULL || n <= 0)
+		return -1;
+
+	uthread_testcancel();
+
+	preempt_disable();
+
+	wait.first = -1;
+	exited = join_register(&wait, tids, n, handle);
+	if (exited == -1) {
+		preempt_enable();
+		return -1;
+	}
+	wait.remaining = needed - exited;
+
+	/* sleep once, until the exit which brings remaining to zero */
+	while (wait.remaining > 0) {
+		park_wait(&wait.remaining, wait.remaining);
+		preempt_disable();
+
+		/* cancelled, the threads can be joined again by another thread */
+		if (current_thread->cancel_pending && !current_thread->exiting) {
+			join_unregister(tids, n);
+			preempt_enable();
+			uthread_testcancel();
+		}
+	}
+
+	return wait.first;
+}
 
 int uthread_join(uthread_t tid, int *retval)
 {
-	/* main thread and a thread itself cannot be joined */
-	if (tid == 0 || tid == uthread_self())
+	int value;
+
+	if (join_threads(&tid, 1, 1, UTHREAD_HANDLE_INVALID) == -1)
 		return -1;
 
-	struct TCB *tcb = NULL;
+	value = join_collect(tid);
+	preempt_enable();
 
-	/* make sure the TID we will join is in the ready queue*/
-	queue_iterate(ready_queue, find_by_tid, (void*)&tid, (void**)&tcb);
+	/* get the return value */
+	if (retval != NULL)
+		*retval = value;
 
-	if (tcb == NULL)
+	return 0;
+}
+
+int uthread_join_handle(uthread_handle_t handle, int *retval)
+{
+	uthread_t tid = handle & (TABLE_MAX - 1);
+	int value;
+
+	if (handle == UTHREAD_HANDLE_INVALID ||
+	    join_threads(&tid, 1, 1, handle) == -1)
 		return -1;
 
-	/* keep waiting until the child thread finish and is found in zombie queue*/
-	while (1) {
-
-		/* yield to next thread */
-		uthread_yield();
-		
-		struct TCB *tcb = NULL;
-		/* find if zombie_queue has the child thread */
-		queue_iterate(zombie_queue, find_by_tid, (void*)&tid, (void**)&tcb);
-		/* if found in zombie queue*/
-		if (tcb != NULL) {
-			/* get the return value */
-			if (retval != NULL)
-				*retval = tcb->retval;
-			/* parent thread now can continue to run */
-			break;
+	value = join_collect(tid);
+	preempt_enable();
+
+	if (retval != NULL)
+		*retval = value;
+
+	return 0;
+}
+
+int uthread_join_all(uthread_t *tids, int n, int *retvals)
+{
+	int value;
+
+	if (join_threads(tids, n, n, UTHREAD_HANDLE_INVALID) == -1)
+		return -1;
+
+	for (int i = 0; i < n; i++) {
+		value = join_collect(tids[i]);
+		if (retvals != NULL)
+			retvals[i] = value;
+	}
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_join_any(uthread_t *tids, int n, int *which, int *retval)
+{
+	int first, value;
+
+	first = join_threads(tids, n, 1, UTHREAD_HANDLE_INVALID);
+	if (first == -1)
+		return -1;
+
+	/* the threads which are still running can be joined again */
+	join_unregister(tids, n);
+	value = join_collect(tids[first]);
+	preempt_enable();
+
+	if (which != NULL)
+		*which = first;
+	if (retval != NULL)
+		*retval = value;
+
+	return 0;
+}
+
+/*
+ * request the cancellation of a thread and of all its descendants, depth
+ * first without recursing: a chain of generations can be deeper than the
+ * stack of the calling thread allows
+ */
+static void cancel_tree(struct TCB *root)
+{
+	struct TCB *tcb = root;
+
+	while (tcb != NULL) {
+		tcb->cancel_pending = 1;
+
+		/* a blocked thread is woken up to reach its cancellation point */
+		if (!tcb->exiting)
+			uthread_unblock(tcb);
+
+		if (tcb->children != NULL) {
+			tcb = tcb->children;
+			continue;
 		}
+
+		/* climb up to the first ancestor with a sibling left to visit */
+		while (tcb != root && tcb->sibling_next == NULL)
+			tcb = tcb->parent;
+		tcb = tcb == root ? NULL : tcb->sibling_next;
+	}
+}
+
+int uthread_cancel(uthread_t tid)
+{
+	/* the main thread cannot be cancelled */
+	if (tid == 0)
+		return -1;
+
+	preempt_disable();
+
+	struct TCB *tcb = table_find(tid);
+
+	if (tcb == NULL || tcb->state == Zombie) {
+		preempt_enable();
+		return -1;
 	}
 
+	cancel_tree(tcb);
+
+	preempt_enable();
+
 	return 0;
 }
 
+int uthread_cancel_handle(uthread_handle_t handle)
+{
+	preempt_disable();
+
+	struct TCB *tcb = handle_find(handle);
+
+	/* the main thread cannot be cancelled */
+	if (tcb == NULL || tcb->TID == 0 || tcb->state == Zombie) {
+		preempt_enable();
+		return -1;
+	}
+
+	cancel_tree(tcb);
+
+	preempt_enable();
+
+	return 0;
+}
+
+void uthread_testcancel(void)
+{
+	if (current_thread->cancel_pending && !current_thread->exiting)
+		uthread_exit(UTHREAD_CANCELED);
+}
+
+int uthread_cleanup_push(void (*routine)(void*), void *arg)
+{
+	if (routine == NULL)
+		return -1;
+
+	struct uthread_cleanup *cleanup = malloc(sizeof(struct uthread_cleanup));
+
+	/* malloc failed */
+	if (cleanup == NULL)
+		return -1;
+
+	cleanup->routine = routine;
+	cleanup->arg = arg;
+	cleanup->next = current_thread->cleanup;
+	current_thread->cleanup = cleanup;
+
+	return 0;
+}
+
+void uthread_cleanup_pop(int execute)
+{
+	struct uthread_cleanup *cleanup = current_thread->cleanup;
+
+	if (cleanup == NULL)
+		return;
+
+	current_thread->cleanup = cleanup->next;
+	if (execute)
+		cleanup->routine(cleanup->arg);
+	free(cleanup);
+}
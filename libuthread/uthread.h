@@ -1,17 +1,37 @@
 #ifndef _UTHREAD_H
 #define _UTHREAD_H
 
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
 /*
  * uthread_t - Thread identifier (TID) type
  *
  * Each user thread is assigned a different TID. TID are assigned in increasing
  * order and numbered starting from 1 (apart from the 'main' thread who
- * automatically gets TID #0). Overflowing the current TID value is considered a
- * case of failure (in other words, it is impossible to create more than
- * USHRT_MAX threads).
+ * automatically gets TID #0). After USHRT_MAX, TIDs wrap around and the TIDs
+ * of the threads which were reclaimed (joined, or exited if detached) are
+ * reused, so a TID only identifies a thread until it is reclaimed. It is
+ * impossible to have more than USHRT_MAX threads which were not reclaimed.
  */
 typedef unsigned short uthread_t;
 
+/*
+ * uthread_handle_t - Thread handle type
+ *
+ * A handle identifies a thread for the whole life of the process: it holds the
+ * TID of the thread in its low 16 bits and, above, a generation number which
+ * changes each time the TID is reused. Functions taking a handle fail instead
+ * of acting on another thread once the thread of the handle was reclaimed.
+ */
+typedef uint64_t uthread_handle_t;
+
+/*
+ * UTHREAD_HANDLE_INVALID - Handle of no thread
+ */
+#define UTHREAD_HANDLE_INVALID ((uthread_handle_t)0)
+
 /*
  * uthread_func_t - Thread function type
  *
@@ -28,8 +48,11 @@ typedef int (*uthread_func_t)(void);
  * calling thread as the 'main' user-level thread (TID 0). If @preempt is
  * `true`, then preemptive scheduling is enabled.
  *
+ * Programs linked with libuthread-coop.a, built without preemption, must pass
+ * 0 as @preempt.
+ *
  * Return: 0 in case of success, -1 in case of failure (e.g., memory
- * allocation).
+ * allocation, or @preempt with libuthread-coop.a).
  */
 int uthread_start(int preempt);
 
@@ -51,8 +74,8 @@ int uthread_stop(void);
  * This function creates a new thread running the function @func and returns the
  * TID of this new thread.
  *
- * Return: -1 in case of failure (memory allocation, context creation, TID
- * overflow, etc.), or the TID of the new thread.
+ * Return: -1 in case of failure (memory allocation, context creation, no free
+ * TID, etc.), or the TID of the new thread.
  */
 int uthread_create(uthread_func_t func);
 
@@ -63,6 +86,142 @@ int uthread_create(uthread_func_t func);
  */
 uthread_t uthread_self(void);
 
+/*
+ * uthread_create_handle - Create a new thread and get its handle
+ * @func: Function to be executed by the thread
+ *
+ * Same as uthread_create(), except that the handle of the new thread is
+ * returned instead of its TID.
+ *
+ * Return: UTHREAD_HANDLE_INVALID in case of failure, or the handle of the new
+ * thread.
+ */
+uthread_handle_t uthread_create_handle(uthread_func_t func);
+
+/*
+ * uthread_self_handle - Get thread handle
+ *
+ * Return: The handle of the currently running thread
+ */
+uthread_handle_t uthread_self_handle(void);
+
+/*
+ * uthread_handle - Get the handle of a thread from its TID
+ * @tid: TID of the thread
+ *
+ * Return: UTHREAD_HANDLE_INVALID if no thread has the TID @tid, or the handle
+ * of the thread which has it.
+ */
+uthread_handle_t uthread_handle(uthread_t tid);
+
+/*
+ * uthread_handle_tid - Get the TID of a thread from its handle
+ * @handle: Handle of the thread
+ *
+ * Return: -1 if the thread of @handle was reclaimed, or its TID.
+ */
+int uthread_handle_tid(uthread_handle_t handle);
+
+/*
+ * uthread_group_t - Scheduling group type
+ *
+ * Threads are scheduled by group: each group receives a share of the CPU in
+ * proportion to its weight, whatever its number of threads, and its ready
+ * threads share it in round-robin order. Threads belong to the group of the
+ * thread which created them, the main thread to a default group of weight
+ * UTHREAD_WEIGHT_DEFAULT.
+ */
+typedef struct uthread_group *uthread_group_t;
+
+#define UTHREAD_WEIGHT_DEFAULT 1024
+#define UTHREAD_WEIGHT_MAX 65536
+
+/*
+ * uthread_group_create - Create a scheduling group
+ * @weight: Share of the CPU of the group, relative to the other groups, from
+ *	1 to UTHREAD_WEIGHT_MAX
+ *
+ * Return: The new group, or NULL if @weight is out of range or in case of
+ * memory allocation error.
+ */
+uthread_group_t uthread_group_create(unsigned int weight);
+
+/*
+ * uthread_group_destroy - Destroy a scheduling group
+ * @group: Group to destroy
+ *
+ * Return: -1 if @group is NULL, is the default group, or still has threads
+ * which did not exit. 0 otherwise.
+ */
+int uthread_group_destroy(uthread_group_t group);
+
+/*
+ * uthread_group_self - Get the group of the currently running thread
+ *
+ * Return: The group of the currently running thread
+ */
+uthread_group_t uthread_group_self(void);
+
+/*
+ * uthread_group_cpu_time - Get the CPU time used by a group
+ * @group: Group to look at
+ *
+ * Return: The CPU time used by the threads of @group so far, in nanoseconds,
+ * or 0 if @group is NULL.
+ */
+uint64_t uthread_group_cpu_time(uthread_group_t group);
+
+/*
+ * uthread_create_group - Create a new thread in a group
+ * @group: Group of the new thread
+ * @func: Function to be executed by the thread
+ *
+ * Same as uthread_create(), except that the new thread belongs to @group.
+ *
+ * Return: -1 if @group is NULL or in case of failure during thread creation.
+ * Otherwise return TID of new thread.
+ */
+int uthread_create_group(uthread_group_t group, uthread_func_t func);
+
+/*
+ * uthread_set_deadline - Set the deadline of the currently running thread
+ * @usec: Deadline, in microseconds from now, or 0 to clear the deadline
+ *
+ * A thread with a deadline is scheduled before all the threads without one,
+ * whatever their group, and before the threads with a later deadline (earliest
+ * deadline first). When it becomes ready while a thread with a later deadline
+ * or without deadline runs, it preempts that thread at once if preemption is
+ * enabled, and at the next scheduling point otherwise.
+ *
+ * The previous deadline of the thread ends, and is counted as met or missed
+ * in the statistics of uthread_get_stats(). So is the deadline of a thread
+ * when it exits.
+ *
+ * Return: -1 if the library is not started. 0 otherwise.
+ */
+int uthread_set_deadline(unsigned long usec);
+
+/*
+ * struct uthread_stats - Scheduler statistics
+ * @deadlines_met: Number of deadlines which ended on time
+ * @deadlines_missed: Number of deadlines which ended late
+ * @mutex_boosts: Number of times the owner of a mutex inherited the earlier
+ * deadline of a thread waiting for it
+ */
+struct uthread_stats {
+	unsigned long deadlines_met;
+	unsigned long deadlines_missed;
+	unsigned long mutex_boosts;
+};
+
+/*
+ * uthread_get_stats - Get the statistics of the scheduler
+ * @stats: Address of the structure to fill
+ *
+ * Return: -1 if @stats is NULL. 0 otherwise.
+ */
+int uthread_get_stats(struct uthread_stats *stats);
+
 /*
  * uthread_yield - Yield execution
  *
@@ -71,6 +230,23 @@ uthread_t uthread_self(void);
  */
 void uthread_yield(void);
 
+/*
+ * uthread_yield_to - Yield execution to a given thread
+ * @tid: TID of the thread to run
+ *
+ * This function is to be called from the currently active and running thread in
+ * order to hand the CPU directly to the ready thread @tid, instead of the
+ * oldest ready thread. The calling thread goes to the end of the ready queue,
+ * as with uthread_yield().
+ *
+ * Threads woken up by another thread (e.g. when a future they wait for
+ * completes) are also run next, ahead of the ready queue.
+ *
+ * Return: -1 if @tid is the TID of the calling thread or if thread @tid is not
+ * ready to run. 0 otherwise, once the calling thread runs again.
+ */
+int uthread_yield_to(uthread_t tid);
+
 /*
  * uthread_exit - Exit from currently running thread
  * @retval: Return value
@@ -104,4 +280,900 @@ void uthread_exit(int retval);
  */
 int uthread_join(uthread_t tid, int *retval);
 
+/*
+ * uthread_join_all - Join a set of threads
+ * @tids: Array of the TIDs of the threads to join
+ * @n: Number of threads in @tids
+ * @retvals: Array of @n integers that will receive the return values
+ *
+ * This function makes the calling thread wait for all the threads of @tids to
+ * complete, and assigns their return values to @retvals (if @retvals is not
+ * NULL). The calling thread is woken up only once, by the last exit.
+ *
+ * Return: -1 if @tids is NULL, if @n is not positive, or if one of the threads
+ * cannot be joined as with uthread_join() (including a TID present twice in
+ * @tids), in which case no thread is joined. 0 otherwise.
+ */
+int uthread_join_all(uthread_t *tids, int n, int *retvals);
+
+/*
+ * uthread_join_any - Join the first thread of a set to complete
+ * @tids: Array of the TIDs of the threads to wait for
+ * @n: Number of threads in @tids
+ * @which: Address of an integer that will receive the index of the thread
+ * @retval: Address of an integer that will receive the return value
+ *
+ * This function makes the calling thread wait for one of the threads of @tids
+ * to complete, joins it, and assigns its index in @tids to @which and its
+ * return value to @retval (if they are not NULL). If several threads already
+ * completed, the first one in @tids is joined. The other threads are left
+ * running and can be joined again.
+ *
+ * Return: -1 if @tids is NULL, if @n is not positive, or if one of the threads
+ * cannot be joined as with uthread_join(). 0 otherwise.
+ */
+int uthread_join_any(uthread_t *tids, int n, int *which, int *retval);
+
+/*
+ * uthread_join_handle - Join a thread from its handle
+ * @handle: Handle of the thread to join
+ * @retval: Address of an integer that will receive the return value
+ *
+ * Same as uthread_join(), for the thread of @handle.
+ *
+ * Return: -1 if the thread of @handle was reclaimed (in particular, if it was
+ * already joined) or cannot be joined as with uthread_join(). 0 otherwise.
+ */
+int uthread_join_handle(uthread_handle_t handle, int *retval);
+
+/*
+ * UTHREAD_CANCELED - Return value of cancelled threads
+ */
+#define UTHREAD_CANCELED (-ECANCELED)
+
+/*
+ * uthread_cancel - Cancel a thread
+ * @tid: TID of the thread to cancel
+ *
+ * This function requests the cancellation of thread @tid and of all the
+ * threads it created, directly or not, which are still running. A cancelled
+ * thread stops at its next cancellation point: uthread_yield(),
+ * uthread_join(), uthread_sleep(), uthread_wait_fd(), uthread_offload(),
+ * waiting for a future, or uthread_testcancel(). A thread blocked in one of
+ * these functions is woken up at once. Being preempted is not a cancellation
+ * point: a thread computing without calling any of them keeps running.
+ *
+ * A cancelled thread runs its cleanup handlers and exits with the return value
+ * UTHREAD_CANCELED. Its stack is freed as soon as it exits, and its TCB when it
+ * is joined (or at once if it is detached).
+ *
+ * Return: -1 if @tid is 0 or if thread @tid cannot be found or already exited.
+ * 0 otherwise.
+ */
+int uthread_cancel(uthread_t tid);
+
+/*
+ * uthread_cancel_handle - Cancel a thread from its handle
+ * @handle: Handle of the thread to cancel
+ *
+ * Same as uthread_cancel(), for the thread of @handle.
+ *
+ * Return: -1 if @handle is the handle of the main thread, or if its thread
+ * exited. 0 otherwise.
+ */
+int uthread_cancel_handle(uthread_handle_t handle);
+
+/*
+ * uthread_testcancel - Cancellation point
+ *
+ * Exit with UTHREAD_CANCELED if the cancellation of the currently running
+ * thread was requested.
+ */
+void uthread_testcancel(void);
+
+/*
+ * uthread_cleanup_push - Push a cleanup handler
+ * @routine: Function to call
+ * @arg: Argument to pass to @routine
+ *
+ * Cleanup handlers are called from the most recently pushed when the thread
+ * exits, whether it was cancelled, called uthread_exit() or returned.
+ *
+ * Return: -1 if @routine is NULL, or in case of memory allocation error. 0
+ * otherwise.
+ */
+int uthread_cleanup_push(void (*routine)(void*), void *arg);
+
+/*
+ * uthread_cleanup_pop - Pop a cleanup handler
+ * @execute: Whether to call the handler
+ *
+ * Remove the most recently pushed cleanup handler of the currently running
+ * thread, and call it if @execute is not 0.
+ */
+void uthread_cleanup_pop(int execute);
+
+/*
+ * uthread_sleep - Sleep for a while
+ * @usec: Time to sleep for, in microseconds
+ *
+ * The calling thread is blocked until @usec microseconds have passed, while
+ * other threads run. When no thread is ready to run, the process sleeps until
+ * the earliest wake time of the sleeping threads.
+ *
+ * Return: -1 in case of memory allocation error, 0 otherwise.
+ */
+int uthread_sleep(unsigned long usec);
+
+/*
+ * uthread_wait_fd - Wait for a file descriptor
+ * @fd: File descriptor to wait for
+ * @events: Events to wait for, as a mask of POLLIN, POLLOUT, etc.
+ *
+ * The calling thread is blocked until file descriptor @fd is ready for one of
+ * @events, while other threads run. When no thread is ready to run, the process
+ * sleeps until a file descriptor becomes ready. Otherwise, the file descriptors
+ * are checked at the first scheduling pass 50 microseconds or more after the
+ * previous check. A file descriptor can only be waited for by one thread at a
+ * time.
+ *
+ * Return: -1 if @fd cannot be waited for (e.g. it is not valid, it does not
+ * support polling, or another thread already waits for it). The events which
+ * occurred on @fd otherwise, including POLLERR and POLLHUP.
+ */
+int uthread_wait_fd(int fd, unsigned int events);
+
+/*
+ * uthread_key_t - Thread-specific data key type
+ *
+ * A key identifies one value per thread, which starts as NULL in every thread.
+ * At most UTHREAD_KEYS_MAX keys can be created during the life of the process,
+ * deleted keys are not reused.
+ */
+typedef unsigned int uthread_key_t;
+
+#define UTHREAD_KEYS_MAX 128
+
+/*
+ * uthread_key_create - Create a thread-specific data key
+ * @key: Address of a key that will receive the new key
+ * @destructor: (Optional) Function called with the value of the key when a
+ *	thread exits with a non-NULL value
+ *
+ * Keys are meant to be created once, before threads use them. Looking up the
+ * value of one of the first keys created is a single indexed load in the TCB.
+ *
+ * Return: -1 if @key is NULL or if UTHREAD_KEYS_MAX keys were already created.
+ * 0 otherwise.
+ */
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void*));
+
+/*
+ * uthread_key_delete - Delete a thread-specific data key
+ * @key: Key to delete
+ *
+ * The values of @key are not destroyed, and its destructor is not called.
+ *
+ * Return: -1 if @key is not a valid key. 0 otherwise.
+ */
+int uthread_key_delete(uthread_key_t key);
+
+/*
+ * uthread_getspecific - Get the value of a key for the current thread
+ * @key: Key of the value
+ *
+ * Return: The value of @key in the currently running thread, or NULL if @key
+ * is not a valid key or has no value.
+ */
+void *uthread_getspecific(uthread_key_t key);
+
+/*
+ * uthread_setspecific - Set the value of a key for the current thread
+ * @key: Key of the value
+ * @value: New value
+ *
+ * Return: -1 if @key is not a valid key, or in case of memory allocation error
+ * when storing the value. 0 otherwise.
+ */
+int uthread_setspecific(uthread_key_t key, void *value);
+
+/*
+ * uthread_future_t - Future type
+ *
+ * A future holds the result of a function run asynchronously in its own thread
+ * by uthread_async(). Any number of threads can wait for the same future, and
+ * waiting threads are woken directly by the thread completing the future.
+ */
+typedef struct uthread_future* uthread_future_t;
+
+/*
+ * uthread_async_func_t - Asynchronous function type
+ * @arg: Argument given to uthread_async()
+ *
+ * Return: Result of the function, stored in its future
+ */
+typedef void *(*uthread_async_func_t)(void *arg);
+
+/*
+ * uthread_async - Run a function asynchronously
+ * @func: Function to be executed
+ * @arg: Argument to pass to @func
+ *
+ * This function creates a new thread running @func with argument @arg, and
+ * returns a future which receives the return value of @func when it completes.
+ * The thread is detached: it cannot be joined and is reclaimed as soon as it
+ * finishes.
+ *
+ * Return: The future of @func, or NULL in case of failure
+ */
+uthread_future_t uthread_async(uthread_async_func_t func, void *arg);
+
+/*
+ * uthread_future_get - Get the result of a future
+ * @future: Future to wait for
+ * @result: (Optional) Address of a pointer that will receive the result
+ *
+ * This function makes the calling thread wait until @future completes, and
+ * assign the result of its function to @result (if @result is not NULL).
+ *
+ * Return: -1 if @future is NULL, 0 otherwise.
+ */
+int uthread_future_get(uthread_future_t future, void **result);
+
+/*
+ * uthread_future_destroy - Deallocate a future
+ * @future: Future to deallocate
+ *
+ * The future may be destroyed before it completes, in which case its result is
+ * discarded. No thread may be waiting for @future.
+ *
+ * Return: -1 if @future is NULL, 0 otherwise.
+ */
+int uthread_future_destroy(uthread_future_t future);
+
+/*
+ * uthread_when_all - Wait for all futures
+ * @futures: Array of futures
+ * @n: Number of futures in @futures
+ *
+ * This function makes the calling thread wait until every future of @futures
+ * has completed. The calling thread is woken once, by the last completion.
+ *
+ * Return: -1 if @futures is NULL or one of the futures is NULL, or in case of
+ * memory allocation error. 0 otherwise.
+ */
+int uthread_when_all(uthread_future_t *futures, int n);
+
+/*
+ * uthread_when_any - Wait for any future
+ * @futures: Array of futures
+ * @n: Number of futures in @futures
+ *
+ * This function makes the calling thread wait until at least one future of
+ * @futures has completed.
+ *
+ * Return: -1 if @futures is NULL, @n is not positive or one of the futures is
+ * NULL, or in case of memory allocation error. The index in @futures of the
+ * first future found completed otherwise.
+ */
+int uthread_when_any(uthread_future_t *futures, int n);
+
+/*
+ * uthread_offload_config - Configure the offload pool
+ * @threads: Number of helper kernel threads
+ * @depth: Maximum number of jobs submitted and not completed yet, rounded up
+ *	to a power of two
+ *
+ * This function must be called before the first call to uthread_offload(),
+ * which starts the pool. By default, the pool has 4 helper threads and up to
+ * 64 waiting jobs.
+ *
+ * Return: -1 if @threads or @depth are not positive or if the pool is already
+ * started. 0 otherwise.
+ */
+int uthread_offload_config(int threads, int depth);
+
+/*
+ * uthread_offload - Run a blocking function on a helper kernel thread
+ * @func: Function to run, which may block or compute for a long time
+ * @arg: Argument to pass to @func
+ * @result: (Optional) Address of a pointer that will receive the result
+ *
+ * The calling thread is blocked while @func runs on one of the helper kernel
+ * threads of the offload pool, and is made ready again with the result of
+ * @func once it returns. Other threads keep running meanwhile, so blocking
+ * system calls (e.g. open(), fsync(), getaddrinfo()) or CPU-heavy library calls
+ * do not stall them. When the pool already holds as many jobs as its depth,
+ * running, waiting or completed, the calling thread first waits for one of
+ * them to be returned to its thread.
+ *
+ * @func runs outside of the threading library: it must not call any uthread
+ * function.
+ *
+ * Return: -1 if @func is NULL, or if the pool cannot be started. 0 otherwise.
+ */
+int uthread_offload(uthread_async_func_t func, void *arg, void **result);
+
+/*
+ * uthread_submit_remote - Run a function in a new thread, from any thread
+ * @func: Function to run in the new thread
+ * @arg: Argument to pass to @func
+ *
+ * Unlike the other functions of the library, this function can be called from
+ * any kernel thread while the library is started, e.g. from the threads of
+ * another library. The request is pushed in a lock-free inbox, and the
+ * scheduler creates a detached thread running @func when it drains the inbox,
+ * at its next scheduling pass. The event loop is only notified through a file
+ * descriptor if it sleeps. The result of @func is ignored, and the request is
+ * dropped if the thread cannot be created.
+ *
+ * With preemption enabled, the calling kernel threads should block SIGVTALRM.
+ *
+ * Return: -1 if @func is NULL or in case of memory allocation failure, 0
+ * otherwise.
+ */
+int uthread_submit_remote(uthread_async_func_t func, void *arg);
+
+/*
+ * uthread_wake_remote - Wake a thread up, from any kernel thread
+ * @handle: Handle of the thread to wake up
+ *
+ * Can be called from any kernel thread, as uthread_submit_remote(). The thread
+ * of @handle returns from uthread_wait_remote() at the next scheduling pass,
+ * or from its next call if it is not waiting. A wakeup for a thread which
+ * exited is ignored.
+ *
+ * Return: -1 if @handle is UTHREAD_HANDLE_INVALID or in case of memory
+ * allocation failure, 0 otherwise.
+ */
+int uthread_wake_remote(uthread_handle_t handle);
+
+/*
+ * uthread_wait_remote - Wait for a wakeup from another kernel thread
+ *
+ * Block the calling thread until uthread_wake_remote() is called with its
+ * handle, or return at once if it was called since the last wait. While a
+ * thread waits, the scheduler sleeps instead of reporting a deadlock when no
+ * other thread can run. This function is a cancellation point.
+ */
+void uthread_wait_remote(void);
+
+/*
+ * uthread_exec_t - Executor type
+ *
+ * An executor runs the jobs submitted to it with at most a given number of
+ * threads at once, and keeps a bounded number of jobs waiting for a thread.
+ */
+typedef struct uthread_exec *uthread_exec_t;
+
+/*
+ * struct uthread_exec_stats - Executor statistics
+ * @running: Number of threads of the executor
+ * @pending: Number of jobs waiting for a thread
+ * @pending_peak: Highest value of @pending so far
+ * @submitted: Number of jobs accepted
+ * @completed: Number of jobs which returned
+ * @rejected: Number of jobs refused by uthread_exec_try_submit()
+ */
+struct uthread_exec_stats {
+	int running;
+	int pending;
+	int pending_peak;
+	unsigned long submitted;
+	unsigned long completed;
+	unsigned long rejected;
+};
+
+/*
+ * uthread_exec_create - Create an executor
+ * @max_threads: Maximum number of threads running jobs at once
+ * @max_pending: Maximum number of jobs waiting for a thread
+ *
+ * Return: NULL if @max_threads is not positive, if @max_pending is negative, or
+ * in case of memory allocation failure. The new executor otherwise.
+ */
+uthread_exec_t uthread_exec_create(int max_threads, int max_pending);
+
+/*
+ * uthread_exec_submit - Submit a job to an executor
+ * @exec: Executor to run the job
+ * @func: Function to run
+ * @arg: Argument to pass to @func
+ *
+ * If fewer than @max_threads threads of @exec run, a detached thread is created
+ * to run @func. Otherwise the job waits in @exec, and a thread which finishes a
+ * job takes the next waiting one instead of exiting. When @max_pending jobs are
+ * already waiting, the calling thread is parked until one of them leaves. The
+ * result of @func is ignored. This function is a cancellation point.
+ *
+ * Return: -1 if @exec or @func is NULL, or in case of memory allocation
+ * failure. 0 otherwise.
+ */
+int uthread_exec_submit(uthread_exec_t exec, uthread_async_func_t func,
+			void *arg);
+
+/*
+ * uthread_exec_try_submit - Submit a job to an executor if it has room
+ * @exec: Executor to run the job
+ * @func: Function to run
+ * @arg: Argument to pass to @func
+ *
+ * Same as uthread_exec_submit(), except that the job is rejected at once
+ * instead of waiting for room.
+ *
+ * Return: -1 if @exec or @func is NULL, in case of memory allocation failure,
+ * or if @exec is full. 0 otherwise.
+ */
+int uthread_exec_try_submit(uthread_exec_t exec, uthread_async_func_t func,
+			    void *arg);
+
+/*
+ * uthread_exec_get_stats - Get the statistics of an executor
+ * @exec: Executor
+ * @stats: Address of the structure to fill
+ *
+ * Return: -1 if @exec or @stats is NULL. 0 otherwise.
+ */
+int uthread_exec_get_stats(uthread_exec_t exec,
+			   struct uthread_exec_stats *stats);
+
+/*
+ * uthread_exec_destroy - Destroy an executor
+ * @exec: Executor to destroy
+ *
+ * Wait until every job submitted to @exec completed, then free it. No job may
+ * be submitted to @exec meanwhile. This function is a cancellation point.
+ *
+ * Return: -1 if @exec is NULL. 0 otherwise.
+ */
+int uthread_exec_destroy(uthread_exec_t exec);
+
+/*
+ * uthread_park - Wait on an address
+ * @addr: Address to wait on
+ * @expected: Value @addr is expected to hold
+ *
+ * If @addr still holds @expected, the calling thread is blocked until another
+ * thread calls uthread_unpark() on @addr. The check and the blocking are
+ * atomic with respect to uthread_unpark(): a thread which changes the value at
+ * @addr and then calls uthread_unpark() always wakes up a thread parked after
+ * reading the old value. This is the building block of the other blocking
+ * primitives, and a cancellation point.
+ *
+ * Return: -1 if @addr is NULL or does not hold @expected. 0 otherwise, which
+ * does not guarantee that the value changed.
+ */
+int uthread_park(const int *addr, int expected);
+
+/*
+ * uthread_unpark - Wake up threads waiting on an address
+ * @addr: Address the threads wait on
+ * @n: Maximum number of threads to wake up, INT_MAX for all of them
+ *
+ * Return: -1 if @addr is NULL or if @n is not positive, the number of threads
+ * woken up otherwise.
+ */
+int uthread_unpark(const int *addr, int n);
+
+/*
+ * uthread_mutex_t - Mutex type
+ *
+ * A mutex is free when initialized with UTHREAD_MUTEX_INITIALIZER or
+ * uthread_mutex_init(). It needs no destruction. Its fields are private.
+ */
+typedef struct uthread_mutex {
+	int state;
+	/* the owner is in the list of boosted mutexes of its TCB */
+	int linked;
+	void *owner;
+	struct uthread_mutex *next;
+	/*
+	 * earliest deadline of the waiters, lent to the owner, until there are
+	 * no waiters left
+	 */
+	int waiters;
+	uint64_t boost;
+} uthread_mutex_t;
+
+#define UTHREAD_MUTEX_INITIALIZER { 0, 0, NULL, NULL, 0, 0 }
+
+/*
+ * uthread_mutex_init - Initialize a mutex
+ * @mutex: Mutex to initialize
+ *
+ * Return: -1 if @mutex is NULL. 0 otherwise.
+ */
+int uthread_mutex_init(uthread_mutex_t *mutex);
+
+/*
+ * uthread_mutex_lock - Lock a mutex
+ * @mutex: Mutex to lock
+ *
+ * The calling thread is blocked until @mutex is free. This is not a
+ * cancellation point.
+ *
+ * A thread with a deadline (see uthread_set_deadline()) which blocks lends it
+ * to the owner of @mutex, if that deadline is earlier than the one the owner
+ * is scheduled by, so that threads without a deadline cannot keep the owner
+ * from releasing @mutex. If the owner itself waits for a mutex, the deadline
+ * is lent along the chain of owners. The owner gives the deadline back when
+ * it unlocks @mutex; the boosts are counted in struct uthread_stats.
+ *
+ * Return: -1 if @mutex is NULL. 0 otherwise.
+ */
+int uthread_mutex_lock(uthread_mutex_t *mutex);
+
+/*
+ * uthread_mutex_trylock - Lock a mutex if it is free
+ * @mutex: Mutex to lock
+ *
+ * Return: -1 if @mutex is NULL or already locked. 0 otherwise.
+ */
+int uthread_mutex_trylock(uthread_mutex_t *mutex);
+
+/*
+ * uthread_mutex_unlock - Unlock a mutex
+ * @mutex: Mutex locked by the calling thread
+ *
+ * Return: -1 if @mutex is NULL. 0 otherwise.
+ */
+int uthread_mutex_unlock(uthread_mutex_t *mutex);
+
+/*
+ * uthread_cond_t - Condition variable type
+ */
+typedef struct {
+	int seq;
+} uthread_cond_t;
+
+#define UTHREAD_COND_INITIALIZER { 0 }
+
+/*
+ * uthread_cond_init - Initialize a condition variable
+ * @cond: Condition variable to initialize
+ *
+ * Return: -1 if @cond is NULL. 0 otherwise.
+ */
+int uthread_cond_init(uthread_cond_t *cond);
+
+/*
+ * uthread_cond_wait - Wait on a condition variable
+ * @cond: Condition variable to wait on
+ * @mutex: Mutex locked by the calling thread
+ *
+ * This function unlocks @mutex, blocks the calling thread until @cond is
+ * signaled, and locks @mutex again. The thread may also be woken up without a
+ * signal: the condition must be checked again in a loop. This is a
+ * cancellation point; a cancelled thread exits with @mutex locked, which a
+ * cleanup handler should unlock.
+ *
+ * Return: -1 if @cond or @mutex is NULL. 0 otherwise.
+ */
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex);
+
+/*
+ * uthread_cond_signal - Wake up a thread waiting on a condition variable
+ * @cond: Condition variable to signal
+ *
+ * Return: -1 if @cond is NULL. 0 otherwise.
+ */
+int uthread_cond_signal(uthread_cond_t *cond);
+
+/*
+ * uthread_cond_broadcast - Wake up all the threads waiting on a condition
+ * variable
+ * @cond: Condition variable to signal
+ *
+ * Return: -1 if @cond is NULL. 0 otherwise.
+ */
+int uthread_cond_broadcast(uthread_cond_t *cond);
+
+/*
+ * uthread_rwlock_t - Reader-writer lock type
+ *
+ * A reader-writer lock is free when initialized with
+ * UTHREAD_RWLOCK_INITIALIZER or uthread_rwlock_init(). It needs no
+ * destruction.
+ */
+typedef struct {
+	int readers;
+	int writer;
+	int writers_waiting;
+	int readers_waiting;
+	/* changed to wake up the parked readers, or writers */
+	int readers_seq;
+	int writers_seq;
+} uthread_rwlock_t;
+
+#define UTHREAD_RWLOCK_INITIALIZER { 0, 0, 0, 0, 0, 0 }
+
+/*
+ * uthread_rwlock_init - Initialize a reader-writer lock
+ * @rwlock: Reader-writer lock to initialize
+ *
+ * Return: -1 if @rwlock is NULL. 0 otherwise.
+ */
+int uthread_rwlock_init(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_rdlock - Lock a reader-writer lock for reading
+ * @rwlock: Reader-writer lock to lock
+ *
+ * Any number of threads can hold @rwlock for reading at once. Writers are
+ * preferred: the calling thread is blocked while a writer holds @rwlock or
+ * waits for it, so that a stream of readers cannot starve the writers. When
+ * the last writer unlocks, the parked readers are all made ready in a single
+ * batch. This is not a cancellation point.
+ *
+ * Return: -1 if @rwlock is NULL. 0 otherwise.
+ */
+int uthread_rwlock_rdlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_tryrdlock - Lock a reader-writer lock for reading if possible
+ * @rwlock: Reader-writer lock to lock
+ *
+ * Return: -1 if @rwlock is NULL or if uthread_rwlock_rdlock() would block. 0
+ * otherwise.
+ */
+int uthread_rwlock_tryrdlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_wrlock - Lock a reader-writer lock for writing
+ * @rwlock: Reader-writer lock to lock
+ *
+ * The calling thread is blocked until no other thread holds @rwlock. This is
+ * not a cancellation point.
+ *
+ * Return: -1 if @rwlock is NULL. 0 otherwise.
+ */
+int uthread_rwlock_wrlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_trywrlock - Lock a reader-writer lock for writing if it is
+ * free
+ * @rwlock: Reader-writer lock to lock
+ *
+ * Return: -1 if @rwlock is NULL or held by a thread. 0 otherwise.
+ */
+int uthread_rwlock_trywrlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_unlock - Unlock a reader-writer lock
+ * @rwlock: Reader-writer lock held by the calling thread
+ *
+ * Return: -1 if @rwlock is NULL. 0 otherwise.
+ */
+int uthread_rwlock_unlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_barrier_t - Barrier type
+ */
+typedef struct {
+	int count;
+	int waiting;
+	int seq;
+} uthread_barrier_t;
+
+/* Returned by uthread_barrier_wait() to a single thread of each phase */
+#define UTHREAD_BARRIER_SERIAL_THREAD 1
+
+/*
+ * uthread_barrier_init - Initialize a barrier
+ * @barrier: Barrier to initialize
+ * @count: Number of threads which must reach the barrier to release it
+ *
+ * Return: -1 if @barrier is NULL or if @count is not positive. 0 otherwise.
+ */
+int uthread_barrier_init(uthread_barrier_t *barrier, int count);
+
+/*
+ * uthread_barrier_wait - Wait for the other threads at a barrier
+ * @barrier: Barrier to wait at
+ *
+ * The calling thread is blocked until @count threads called this function.
+ * The last one to arrive makes the others ready in a single pass over the
+ * parked threads, and the barrier can be used again at once for the next
+ * phase. This is not a cancellation point.
+ *
+ * Return: -1 if @barrier is NULL. UTHREAD_BARRIER_SERIAL_THREAD for the last
+ * thread to arrive, 0 for the others.
+ */
+int uthread_barrier_wait(uthread_barrier_t *barrier);
+
+/*
+ * uthread_once_t - One-time initialization type
+ */
+typedef struct {
+	int state;
+} uthread_once_t;
+
+#define UTHREAD_ONCE_INIT { 0 }
+
+/*
+ * uthread_once - Run an initialization function once
+ * @once: One-time initialization, initialized with UTHREAD_ONCE_INIT
+ * @init: Initialization function
+ *
+ * The first thread to call this function on @once runs @init. The threads
+ * calling it meanwhile are blocked until @init returns; later calls return at
+ * once. If the thread running @init is cancelled, a blocked thread runs it
+ * again. This is not a cancellation point, but @init may contain some.
+ *
+ * Return: -1 if @once or @init is NULL. 0 otherwise.
+ */
+int uthread_once(uthread_once_t *once, void (*init)(void));
+
+/*
+ * uthread_arena_alloc - Allocate memory from the arena of the current thread
+ * @size: Size of the allocation, in bytes
+ *
+ * The memory comes from chunks owned by the calling thread, by moving a
+ * pointer forward. It cannot be freed on its own: the whole arena is released
+ * at once when the thread exits, after its cleanup handlers and thread-specific
+ * data destructors ran. The memory must then no longer be used, by any thread.
+ * The arena of the main thread is released by uthread_stop().
+ *
+ * Return: Pointer to the allocated memory, aligned for any type, or NULL if
+ * @size is 0 or too large to be allocated, if the library is not started, or in
+ * case of memory allocation error.
+ */
+void *uthread_arena_alloc(size_t size);
+
+/*
+ * uthread_affinity_config - Pin the kernel threads of the library to CPUs
+ * @cpus: Array of CPU numbers
+ * @n: Number of CPUs in @cpus
+ *
+ * The calling kernel thread, which runs the scheduler, is pinned to @cpus[0]
+ * at once. The helper threads of the offload pool are pinned in turn to the
+ * other CPUs of the list, or to @cpus[0] if it has a single CPU; the pool must
+ * not be started yet. New thread stacks are then preferably allocated from the
+ * NUMA node of @cpus[0].
+ *
+ * Return: -1 if @cpus is NULL, if @n is not positive, if a CPU number is
+ * invalid, or if the scheduler cannot be pinned to @cpus[0]. 0 otherwise.
+ */
+int uthread_affinity_config(const int *cpus, int n);
+
+/*
+ * uthread_profile_start - Start the sampling profiler
+ * @hz: Number of samples per second of CPU time
+ *
+ * A SIGPROF timer, independent of the preemption timer, interrupts the kernel
+ * thread running the scheduler @hz times per second of its CPU time; the
+ * offload helpers and other kernel threads are neither counted nor
+ * interrupted. Each interruption records the TID of the running thread and its
+ * call stack, found by following frame pointers: code compiled without them
+ * (e.g. with -O2 but without -fno-omit-frame-pointer) shows up as its
+ * innermost function only. The samples stay in a fixed buffer until
+ * uthread_profile_dump() is called; samples taken while it is full are
+ * dropped. Only supported on x86-64.
+ *
+ * Return: -1 if @hz is 0 or above 1000000, if the profiler is already
+ * running, or if it cannot be started. 0 otherwise.
+ */
+int uthread_profile_start(unsigned int hz);
+
+/*
+ * uthread_profile_stop - Stop the sampling profiler
+ *
+ * The samples taken so far can still be dumped.
+ */
+void uthread_profile_stop(void);
+
+/*
+ * uthread_profile_dump - Write the samples as folded stacks
+ * @path: Path of the file to write
+ *
+ * Writes one line per distinct stack, "uthread-<TID>;outer;...;inner count",
+ * the format taken by flamegraph.pl, and empties the sample buffer. Function
+ * names are found with dladdr(): functions of the program itself only have a
+ * name if it was linked with -rdynamic, static functions never do and appear
+ * as addresses.
+ *
+ * Return: -1 if @path is NULL, cannot be written, or in case of memory
+ * allocation error. 0 otherwise.
+ */
+int uthread_profile_dump(const char *path);
+
+/*
+ * uthread_monitor_start - Publish the state of the scheduler in shared memory
+ * @period_ms: Time between two updates, in milliseconds
+ *
+ * Creates the POSIX shared memory segment UTHREAD_MONITOR_NAME, named after
+ * the process ID, which other processes such as apps/uthread_top can map
+ * read-only. Between two threads, at most every @period_ms, the scheduler
+ * writes there the number of threads and of ready threads, and the state, CPU
+ * time and preemption count of each thread; the layout is described in
+ * monitor.h. Until this function is called, the scheduler does not look at
+ * the clock for it.
+ *
+ * Return: -1 if @period_ms is 0, if the library is not started, if the segment
+ * is already published, or if it cannot be created. 0 otherwise.
+ */
+int uthread_monitor_start(unsigned int period_ms);
+
+/*
+ * uthread_monitor_stop - Stop publishing the state of the scheduler
+ *
+ * The segment is removed; processes which mapped it keep its last update.
+ * Called by uthread_stop().
+ *
+ * Return: -1 if the segment was not published. 0 otherwise.
+ */
+int uthread_monitor_stop(void);
+
+/*
+ * uthread_gen_t - Generator type
+ *
+ * A generator is a coroutine producing a sequence of values. It runs on its own
+ * stack but is not a thread: it only runs when its consumer resumes it with
+ * uthread_gen_next(), and it hands control back directly with
+ * uthread_gen_yield(), without going through the scheduler.
+ */
+typedef struct uthread_gen *uthread_gen_t;
+
+/*
+ * uthread_gen_func_t - Generator function type
+ * @gen: Generator running the function
+ * @arg: Argument given to uthread_gen_create()
+ *
+ * Return: Final value of the generator
+ */
+typedef void *(*uthread_gen_func_t)(uthread_gen_t gen, void *arg);
+
+/*
+ * uthread_gen_create - Create a generator
+ * @func: Function of the generator
+ * @arg: Argument to pass to @func
+ *
+ * The generator does not run until its first call to uthread_gen_next(). Its
+ * stack is taken from the pool of stacks shared with threads.
+ *
+ * Return: The new generator, or NULL if @func is NULL or in case of memory
+ * allocation error.
+ */
+uthread_gen_t uthread_gen_create(uthread_gen_func_t func, void *arg);
+
+/*
+ * uthread_gen_next - Resume a generator
+ * @gen: Generator to resume
+ * @in: Value returned by the uthread_gen_yield() call of @gen which is resumed
+ * @out: (Optional) Address of a pointer that will receive the value yielded
+ *	by @gen, or its final value if it finished
+ *
+ * The calling thread runs @gen until it yields a value or returns. @in is
+ * ignored when the generator is resumed for the first time. The generator runs
+ * as part of the calling thread: if it blocks or yields the thread, the calling
+ * thread does.
+ *
+ * Return: -1 if @gen is NULL, already finished, or running (a generator cannot
+ * resume itself). 1 if @gen yielded a value, 0 if it finished.
+ */
+int uthread_gen_next(uthread_gen_t gen, void *in, void **out);
+
+/*
+ * uthread_gen_yield - Hand a value to the consumer of a generator
+ * @gen: Generator currently running
+ * @value: Value to hand to the consumer
+ *
+ * This function must be called from the function of @gen. It returns when the
+ * consumer resumes @gen.
+ *
+ * Return: The value passed by the consumer to uthread_gen_next().
+ */
+void *uthread_gen_yield(uthread_gen_t gen, void *value);
+
+/*
+ * uthread_gen_destroy - Destroy a generator
+ * @gen: Generator to destroy
+ *
+ * A generator may be destroyed before it finished, in which case its function
+ * never returns: resources it holds are not released.
+ *
+ * Return: -1 if @gen is NULL or running. 0 otherwise.
+ */
+int uthread_gen_destroy(uthread_gen_t gen);
+
 #endif /* _THREAD_H */